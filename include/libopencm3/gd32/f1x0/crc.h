@@ -0,0 +1,55 @@
+/** @defgroup crc_defines CRC Defines
+
+@brief <b>Defined Constants and Types for the GD32F1x0 CRC Generator</b>
+
+@ingroup GD32F1x0_defines
+
+@version 1.0.0
+
+LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CRC_H
+#define LIBOPENCM3_CRC_H
+
+#include <libopencm3/stm32/common/crc_common_all.h>
+
+/**@{*/
+
+/* Generator polynomial of the CRC unit, shifted MSB first */
+#define CRC_POLYNOMIAL			0x04C11DB7
+
+/* --- Function prototypes ------------------------------------------------- */
+
+BEGIN_DECLS
+
+void crc_calculate_block_dma_start(uint8_t channel, const uint32_t *datap,
+				   uint16_t size);
+bool crc_calculate_block_dma_done(uint8_t channel);
+uint32_t crc_calculate_block_dma(uint8_t channel, const uint32_t *datap,
+				 uint16_t size);
+uint32_t crc_calculate_tail(uint32_t crc, const uint8_t *data, int len);
+uint32_t crc_calculate_bytes(uint8_t channel, const uint8_t *data,
+			     uint32_t len);
+
+END_DECLS
+
+/**@}*/
+
+#endif
@@ -0,0 +1,58 @@
+/** @defgroup dma_defines DMA Defines
+
+@ingroup GD32F1x0_defines
+
+@brief Defined Constants and Types for the GD32F1x0 DMA Controller
+
+@version 1.0.0
+
+LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_DMA_H
+#define LIBOPENCM3_DMA_H
+
+#include <libopencm3/stm32/common/dma_common_l1f013.h>
+
+/**@{*/
+
+/* --- API definitions ----------------------------------------------------- */
+
+/** DMA transfer descriptor, see @ref dma_start_transfer */
+struct dma_transfer {
+	uint32_t peripheral_address;
+	uint32_t memory_address;
+	uint16_t number;
+	/** DMA_CCR_* configuration bits, DMA_CCR_EN is implied */
+	uint32_t ccr;
+};
+
+/* --- Function prototypes ------------------------------------------------- */
+
+BEGIN_DECLS
+
+void dma_start_transfer(uint32_t dma, uint8_t channel,
+			const struct dma_transfer *xfer);
+
+END_DECLS
+
+/**@}*/
+
+#endif
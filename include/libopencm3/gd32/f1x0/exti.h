@@ -0,0 +1,57 @@
+/** @defgroup exti_defines EXTI Defines
+
+@brief <b>Defined Constants and Types for the GD32F1x0 External Interrupts</b>
+
+@ingroup GD32F1x0_defines
+
+@version 1.0.0
+
+LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_EXTI_H
+#define LIBOPENCM3_EXTI_H
+
+#include <libopencm3/stm32/common/exti_common_all.h>
+#include <libopencm3/stm32/common/exti_common_v1.h>
+
+/**@{*/
+
+/* --- Shared interrupt vectors -------------------------------------------- */
+
+/* Number of GPIO lines handled by @ref exti_dispatch */
+#define EXTI_GPIO_LINES			16
+
+/* Lines sharing each of the GPIO interrupt vectors */
+#define EXTI0_1_LINES			(EXTI0 | EXTI1)
+#define EXTI2_3_LINES			(EXTI2 | EXTI3)
+#define EXTI4_15_LINES			0xfff0
+
+/* --- Function prototypes ------------------------------------------------- */
+
+BEGIN_DECLS
+
+void exti_set_callback(uint8_t line, void (*callback)(uint8_t line));
+void exti_dispatch(uint32_t extis);
+
+END_DECLS
+
+/**@}*/
+
+#endif
@@ -52,9 +52,11 @@
 #define FLASH_ACR_LATENCY_000_024MHZ	0
 #define FLASH_ACR_LATENCY_024_048MHZ	1
 #define FLASH_ACR_LATENCY_048_072MHZ	2
+#define FLASH_ACR_LATENCY_072_108MHZ	3
 #define FLASH_ACR_LATENCY_0WS		0
 #define FLASH_ACR_LATENCY_1WS		1
-#define FLASH_ACR_LATENCY_2WS		1
+#define FLASH_ACR_LATENCY_2WS		2
+#define FLASH_ACR_LATENCY_3WS		3
 /**@}*/
 
 /* --- FLASH_SR values ----------------------------------------------------- */
@@ -91,12 +93,25 @@
 #define FLASH_RDP_L1			((uint8_t)0xf0) /* any value */
 #define FLASH_RDP_L2			((uint8_t)0xcc)
 
+/* Erase granularity of the main flash */
+#define FLASH_PAGE_SIZE			1024
+
 /*****************************************************************************/
 /* API Functions                                                             */
 /*****************************************************************************/
 
 BEGIN_DECLS
 
+void flash_program_buffer(uint32_t address, const uint8_t *data, uint32_t len);
+void flash_erase_pages(uint32_t address, uint32_t len);
+
+/* Run from RAM, see flash_ram.c */
+__attribute__ ((long_call))
+void flash_program_buffer_ram(uint32_t address, const uint8_t *data,
+			      uint32_t len);
+__attribute__ ((long_call))
+void flash_erase_pages_ram(uint32_t address, uint32_t len);
+
 END_DECLS
 /**@}*/
 
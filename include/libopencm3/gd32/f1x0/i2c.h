@@ -0,0 +1,70 @@
+/** @defgroup i2c_defines I2C Defines
+
+@brief <b>Defined Constants and Types for the GD32F1x0 I2C</b>
+
+@ingroup GD32F1x0_defines
+
+@version 1.0.0
+
+LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_I2C_H
+#define LIBOPENCM3_I2C_H
+
+#include <libopencm3/stm32/common/i2c_common_v1.h>
+
+/**@{*/
+
+/* --- DMA request mapping ------------------------------------------------- */
+
+/* Fixed DMA1 channels of the I2C requests */
+#define I2C1_DMA_TX_CHANNEL		2
+#define I2C1_DMA_RX_CHANNEL		3
+#define I2C2_DMA_TX_CHANNEL		4
+#define I2C2_DMA_RX_CHANNEL		5
+
+/* --- Asynchronous transfers ---------------------------------------------- */
+
+/** Result passed to the completion callback of @ref i2c_transfer7_async */
+enum i2c_transfer_status {
+	I2C_TRANSFER_DONE,
+	I2C_TRANSFER_NACK,
+	I2C_TRANSFER_ARBITRATION_LOST,
+	I2C_TRANSFER_BUS_ERROR,
+};
+
+/* --- Function prototypes ------------------------------------------------- */
+
+BEGIN_DECLS
+
+bool i2c_transfer7_async(uint32_t i2c, uint8_t addr,
+			 const uint8_t *w, size_t wn, uint8_t *r, size_t rn,
+			 void (*callback)(uint32_t i2c,
+					  enum i2c_transfer_status status));
+bool i2c_transfer_busy(uint32_t i2c);
+void i2c_ev_isr(uint32_t i2c);
+void i2c_er_isr(uint32_t i2c);
+void i2c_dma_isr(uint32_t i2c);
+
+END_DECLS
+
+/**@}*/
+
+#endif
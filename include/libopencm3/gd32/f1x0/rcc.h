@@ -155,6 +155,22 @@
 #define RCC_CFGR_PLLMUL_PLL_CLK_MUL14		0xc
 #define RCC_CFGR_PLLMUL_PLL_CLK_MUL15		0xd
 #define RCC_CFGR_PLLMUL_PLL_CLK_MUL16		0xe
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL17		0x10
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL18		0x11
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL19		0x12
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL20		0x13
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL21		0x14
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL22		0x15
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL23		0x16
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL24		0x17
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL25		0x18
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL26		0x19
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL27		0x1a
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL28		0x1b
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL29		0x1c
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL30		0x1d
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL31		0x1e
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL32		0x1f
 /**@}*/
 
 /** @defgroup rcc_cfgr_hsepre PLLXTPRE: HSE divider for PLL entry
@@ -448,6 +464,7 @@ struct rcc_clock_scale {
 	uint8_t usbpre; /* Only valid if HSE used */
 	bool use_hse; /* PLL source is HSE if set, HSI/2 if unset */
 	uint8_t pll_hse_prediv; /* Only valid if HSE used */
+	uint8_t flash_waitstates;
 	uint32_t ahb_frequency;
 	uint32_t apb1_frequency;
 	uint32_t apb2_frequency;
@@ -456,6 +473,14 @@ struct rcc_clock_scale {
 extern const struct rcc_clock_scale rcc_hsi_configs[RCC_CLOCK_HSI_END];
 extern const struct rcc_clock_scale rcc_hse8_configs[RCC_CLOCK_HSE8_END];
 
+/* Number of callbacks rcc_clock_change_callback_register() accepts */
+#define RCC_CLOCK_CHANGE_CALLBACKS		4
+
+/* Limits used by rcc_clock_compute_pll() */
+#define RCC_PLL_MAX_FREQUENCY			108000000
+#define RCC_APB1_MAX_FREQUENCY			36000000
+#define RCC_APB2_MAX_FREQUENCY			72000000
+
 enum rcc_osc {
 	RCC_PLL, RCC_HSE, RCC_HSI, RCC_LSE, RCC_LSI
 };
@@ -577,6 +602,10 @@ void rcc_set_usbpre(uint32_t usbpre);
 void rcc_set_prediv(uint32_t prediv);
 uint32_t rcc_system_clock_source(void);
 void rcc_clock_setup_pll(const struct rcc_clock_scale *clock);
+bool rcc_clock_compute_pll(uint32_t sysclk, uint32_t hse_frequency, bool usb,
+			   struct rcc_clock_scale *clock);
+void rcc_clock_switch(const struct rcc_clock_scale *clock);
+bool rcc_clock_change_callback_register(void (*callback)(void));
 void rcc_backupdomain_reset(void);
 
 END_DECLS
@@ -0,0 +1,55 @@
+/** @defgroup spi_defines SPI Defines
+
+@brief <b>Defined Constants and Types for the GD32F1x0 SPI</b>
+
+@ingroup GD32F1x0_defines
+
+@version 1.0.0
+
+LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_SPI_H
+#define LIBOPENCM3_SPI_H
+
+#include <libopencm3/stm32/common/spi_common_v1.h>
+
+/**@{*/
+
+/* --- DMA request mapping ------------------------------------------------- */
+
+/* Fixed DMA1 channels of the SPI requests */
+#define SPI1_DMA_RX_CHANNEL		2
+#define SPI1_DMA_TX_CHANNEL		3
+#define SPI2_DMA_RX_CHANNEL		4
+#define SPI2_DMA_TX_CHANNEL		5
+
+/* --- Function prototypes ------------------------------------------------- */
+
+BEGIN_DECLS
+
+void spi_transfer_dma(uint32_t spi, const void *tx, void *rx, uint16_t len,
+		      void (*callback)(uint32_t spi));
+void spi_dma_isr(uint32_t spi);
+
+END_DECLS
+
+/**@}*/
+
+#endif
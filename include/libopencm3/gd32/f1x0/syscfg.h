@@ -0,0 +1,81 @@
+/** @defgroup syscfg_defines SYSCFG Defines
+
+@brief <b>Defined Constants and Types for the GD32F1x0 System Configuration
+controller</b>
+
+@ingroup GD32F1x0_defines
+
+@version 1.0.0
+
+LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_SYSCFG_H
+#define LIBOPENCM3_SYSCFG_H
+/**@{*/
+
+/*****************************************************************************/
+/* Register definitions                                                      */
+/*****************************************************************************/
+
+#define SYSCFG_CFGR1			MMIO32(SYSCFG_COMP_BASE + 0x00)
+#define SYSCFG_EXTICR(i)		MMIO32(SYSCFG_COMP_BASE + 0x08 + (i)*4)
+#define SYSCFG_EXTICR1			SYSCFG_EXTICR(0)
+#define SYSCFG_EXTICR2			SYSCFG_EXTICR(1)
+#define SYSCFG_EXTICR3			SYSCFG_EXTICR(2)
+#define SYSCFG_EXTICR4			SYSCFG_EXTICR(3)
+#define SYSCFG_CFGR2			MMIO32(SYSCFG_COMP_BASE + 0x18)
+
+/*****************************************************************************/
+/* Register values                                                           */
+/*****************************************************************************/
+
+/* SYSCFG_CFGR1 Values -- ---------------------------------------------------*/
+
+#define SYSCFG_CFGR1_MEM_MODE_SHIFT		0
+#define SYSCFG_CFGR1_MEM_MODE		(3 << SYSCFG_CFGR1_MEM_MODE_SHIFT)
+#define SYSCFG_CFGR1_MEM_MODE_FLASH	(0 << SYSCFG_CFGR1_MEM_MODE_SHIFT)
+#define SYSCFG_CFGR1_MEM_MODE_SYSTEM	(1 << SYSCFG_CFGR1_MEM_MODE_SHIFT)
+#define SYSCFG_CFGR1_MEM_MODE_SRAM	(3 << SYSCFG_CFGR1_MEM_MODE_SHIFT)
+
+#define SYSCFG_CFGR1_ADC_DMA_RMP	(1 << 8)
+#define SYSCFG_CFGR1_USART1_TX_DMA_RMP	(1 << 9)
+#define SYSCFG_CFGR1_USART1_RX_DMA_RMP	(1 << 10)
+#define SYSCFG_CFGR1_TIM16_DMA_RMP	(1 << 11)
+#define SYSCFG_CFGR1_TIM17_DMA_RMP	(1 << 12)
+
+/* SYSCFG_EXTICR Values -- --------------------------------------------------*/
+
+#define SYSCFG_EXTICR_FIELDSIZE		4
+#define SYSCFG_EXTICR_GPIOA		0
+#define SYSCFG_EXTICR_GPIOB		1
+#define SYSCFG_EXTICR_GPIOC		2
+#define SYSCFG_EXTICR_GPIOD		3
+#define SYSCFG_EXTICR_GPIOF		5
+
+/* SYSCFG_CFGR2 Values -- ---------------------------------------------------*/
+
+#define SYSCFG_CFGR2_LOCKUP_LOCK	(1 << 0)
+#define SYSCFG_CFGR2_SRAM_PARITY_LOCK	(1 << 1)
+#define SYSCFG_CFGR2_LVD_LOCK		(1 << 2)
+#define SYSCFG_CFGR2_SRAM_PEF		(1 << 8)
+
+/**@}*/
+
+#endif
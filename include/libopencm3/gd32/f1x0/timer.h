@@ -0,0 +1,88 @@
+/** @defgroup timer_defines Timer Defines
+
+@brief <b>Defined Constants and Types for the GD32F1x0 Timers</b>
+
+@ingroup GD32F1x0_defines
+
+@version 1.0.0
+
+LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_TIMER_H
+#define LIBOPENCM3_TIMER_H
+
+#include <libopencm3/stm32/common/timer_common_all.h>
+
+/**@{*/
+
+/* --- TIMx_DCR values ----------------------------------------------------- */
+
+/* DBL[4:0]: DMA burst length, in transfers minus one */
+#define TIM_DCR_DBL_SHIFT		8
+#define TIM_DCR_DBL_MASK		(0x1f << TIM_DCR_DBL_SHIFT)
+
+/* DBA[4:0]: DMA base address, in words from TIMx_CR1 */
+#define TIM_DCR_DBA_SHIFT		0
+#define TIM_DCR_DBA_MASK		(0x1f << TIM_DCR_DBA_SHIFT)
+
+/** @defgroup tim_dcr_dba TIMx_DCR DMA burst base registers
+@{*/
+#define TIM_DCR_DBA_PSC			10
+#define TIM_DCR_DBA_ARR			11
+#define TIM_DCR_DBA_RCR			12
+#define TIM_DCR_DBA_CCR1		13
+#define TIM_DCR_DBA_CCR2		14
+#define TIM_DCR_DBA_CCR3		15
+#define TIM_DCR_DBA_CCR4		16
+/**@}*/
+
+/* --- DMA request mapping ------------------------------------------------- */
+
+/* Fixed DMA1 channels of the timer update requests */
+#define TIM1_DMA_UP_CHANNEL		5
+#define TIM2_DMA_UP_CHANNEL		2
+#define TIM3_DMA_UP_CHANNEL		3
+#define TIM15_DMA_UP_CHANNEL		5
+#define TIM16_DMA_UP_CHANNEL		3
+#define TIM17_DMA_UP_CHANNEL		1
+
+/** Input Capture input polarity */
+enum tim_ic_pol {
+	TIM_IC_RISING,
+	TIM_IC_FALLING,
+};
+
+/* --- Function prototypes ------------------------------------------------- */
+
+BEGIN_DECLS
+
+void timer_ic_set_polarity(uint32_t timer,
+			   enum tim_ic_id ic,
+			   enum tim_ic_pol pol);
+bool timer_dma_burst_start(uint32_t timer, uint8_t base, uint8_t length,
+			   const uint16_t *table, uint16_t updates,
+			   bool circular);
+void timer_dma_burst_stop(uint32_t timer);
+
+END_DECLS
+
+/**@}*/
+
+#endif
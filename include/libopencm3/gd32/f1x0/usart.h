@@ -0,0 +1,95 @@
+/** @defgroup usart_defines USART Defines
+ *
+ * @brief <b>Defined Constants and Types for the GD32F1x0 USART</b>
+ *
+ * @ingroup GD32F1x0_defines
+ *
+ * @version 1.0.0
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_USART_H
+#define LIBOPENCM3_USART_H
+
+#include <libopencm3/stm32/common/usart_common_all.h>
+#include <libopencm3/stm32/common/usart_common_v2.h>
+
+/**@{*/
+
+/*****************************************************************************/
+/* Module definitions                                                        */
+/*****************************************************************************/
+
+/** @defgroup usart_reg_base USART register base addresses
+ * @{
+ */
+#define USART1				USART1_BASE
+#define USART2				USART2_BASE
+/**@}*/
+
+/*****************************************************************************/
+/* API definitions                                                           */
+/*****************************************************************************/
+
+/** DMA backed USART stream, see @ref usart_stream_init
+ *
+ * The fields before the first comment are filled in by the user, the rest is
+ * private state.
+ */
+struct usart_stream {
+	uint32_t usart;
+	uint32_t dma;
+	uint8_t rx_channel;
+	uint8_t tx_channel;
+	uint8_t *rx_buf;
+	uint16_t rx_size;
+	uint8_t *tx_buf;
+	uint16_t tx_size;
+	/** Called from @ref usart_stream_usart_isr when the RX line goes idle */
+	void (*rx_idle)(struct usart_stream *stream);
+
+	/* private */
+	uint16_t rx_tail;
+	volatile uint16_t tx_head;
+	volatile uint16_t tx_tail;
+	volatile uint16_t tx_pending;
+};
+
+/*****************************************************************************/
+/* API Functions                                                             */
+/*****************************************************************************/
+
+BEGIN_DECLS
+
+void usart_stream_init(struct usart_stream *stream);
+uint16_t usart_stream_rx_available(struct usart_stream *stream);
+uint16_t usart_stream_read(struct usart_stream *stream, uint8_t *data,
+			   uint16_t len);
+uint16_t usart_stream_write(struct usart_stream *stream, const uint8_t *data,
+			    uint16_t len);
+void usart_stream_usart_isr(struct usart_stream *stream);
+void usart_stream_tx_dma_isr(struct usart_stream *stream);
+
+END_DECLS
+
+/**@}*/
+
+#endif
@@ -40,6 +40,8 @@
 #       include <libopencm3/stm32/g0/adc.h>
 #elif defined(STM32G4)
 #       include <libopencm3/stm32/g4/adc.h>
+#elif defined(GD32F1X0)
+#       include <libopencm3/gd32/f1x0/adc.h>
 #else
 #       error "stm32 family not defined."
 #endif
@@ -273,6 +273,29 @@ LGPL License Terms @ref lgpl_license
 		GET_REG(USB_EP_REG(EP)) & \
 		(USB_EP_NTOGGLE_MSK | USB_EP_RX_DTOG))
 
+/* Macros for toggling DTOG bits */
+#define USB_TOG_EP_TX_DTOG(EP) \
+	SET_REG(USB_EP_REG(EP), \
+		(GET_REG(USB_EP_REG(EP)) & USB_EP_NTOGGLE_MSK) | \
+		USB_EP_RX_CTR | USB_EP_TX_CTR | USB_EP_TX_DTOG)
+
+#define USB_TOG_EP_RX_DTOG(EP) \
+	SET_REG(USB_EP_REG(EP), \
+		(GET_REG(USB_EP_REG(EP)) & USB_EP_NTOGGLE_MSK) | \
+		USB_EP_RX_CTR | USB_EP_TX_CTR | USB_EP_RX_DTOG)
+
+/*
+ * Double buffered endpoints only use one direction. The DTOG bit of the
+ * unused direction becomes SW_BUF, the buffer owned by the application,
+ * while DTOG of the used direction selects the buffer owned by the USB
+ * peripheral. Buffer 0 uses the TX descriptor and buffer 1 the RX one.
+ */
+#define USB_EP_TX_SW_BUF	USB_EP_RX_DTOG
+#define USB_EP_RX_SW_BUF	USB_EP_TX_DTOG
+
+#define USB_TOG_EP_TX_SW_BUF(EP)	USB_TOG_EP_RX_DTOG(EP)
+#define USB_TOG_EP_RX_SW_BUF(EP)	USB_TOG_EP_TX_DTOG(EP)
+
 
 /* --- USB BTABLE registers ------------------------------------------------ */
 
@@ -78,6 +78,9 @@
 #define USB_BCDR_DCDEN		(1 << 1)
 #define USB_BCDR_BCDEN		(1 << 0)
 
+/* Size of the packet memory, as addressed by the BTABLE. */
+#define USB_PMA_SIZE		1024
+
 /* --- USB BTABLE registers ------------------------------------------------ */
 
 #define USB_EP_TX_ADDR(ep) \
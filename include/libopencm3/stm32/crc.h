@@ -42,6 +42,8 @@
 #       include <libopencm3/stm32/g0/crc.h>
 #elif defined(STM32G4)
 #       include <libopencm3/stm32/g4/crc.h>
+#elif defined(GD32F1X0)
+#       include <libopencm3/gd32/f1x0/crc.h>
 #else
 #       error "stm32 family not defined."
 #endif
@@ -42,6 +42,8 @@
 #       include <libopencm3/stm32/g0/dma.h>
 #elif defined(STM32G4)
 #       include <libopencm3/stm32/g4/dma.h>
+#elif defined(GD32F1X0)
+#       include <libopencm3/gd32/f1x0/dma.h>
 #else
 #       error "stm32 family not defined."
 #endif
@@ -37,6 +37,8 @@
 #       include <libopencm3/stm32/l4/st_usbfs.h>
 #elif defined(STM32G4)
 #       include <libopencm3/stm32/g4/st_usbfs.h>
+#elif defined(GD32F1X0)
+#       include <libopencm3/gd32/f1x0/st_usbfs.h>
 #else
 #       error "STM32 family not defined or not supported."
 #endif
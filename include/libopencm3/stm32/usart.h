@@ -44,6 +44,8 @@
 #       include <libopencm3/stm32/g4/usart.h>
 #elif defined(STM32H7)
 #       include <libopencm3/stm32/h7/usart.h>
+#elif defined(GD32F1X0)
+#       include <libopencm3/gd32/f1x0/usart.h>
 #else
 #       error "stm32 family not defined."
 #endif
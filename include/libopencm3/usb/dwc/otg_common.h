@@ -81,6 +81,9 @@
 #define OTG_DOEPTSIZ0			0xB10
 #define OTG_DOEPTSIZ(x)			(0xB10 + 0x20*(x))
 #define OTG_DTXFSTS(x)			(0x918 + 0x20*(x))
+/* Only present on cores with internal DMA (OTG_HS) */
+#define OTG_DIEPDMA(x)			(0x914 + 0x20*(x))
+#define OTG_DOEPDMA(x)			(0xB14 + 0x20*(x))
 
 /* Power and clock gating control and status register */
 #define OTG_PCGCCTL			0xE00
@@ -112,6 +115,13 @@
 
 /* OTG AHB configuration register (OTG_GAHBCFG) */
 #define OTG_GAHBCFG_GINT		0x0001
+#define OTG_GAHBCFG_HBSTLEN_SINGLE	(0x0 << 1)
+#define OTG_GAHBCFG_HBSTLEN_INCR	(0x1 << 1)
+#define OTG_GAHBCFG_HBSTLEN_INCR4	(0x3 << 1)
+#define OTG_GAHBCFG_HBSTLEN_INCR8	(0x5 << 1)
+#define OTG_GAHBCFG_HBSTLEN_INCR16	(0x7 << 1)
+#define OTG_GAHBCFG_HBSTLEN_MASK	(0xf << 1)
+#define OTG_GAHBCFG_DMAEN		0x0020
 #define OTG_GAHBCFG_TXFELVL		0x0080
 #define OTG_GAHBCFG_PTXFELVL		0x0100
 
@@ -120,11 +130,16 @@
 #define OTG_GUSBCFG_SRPCAP		0x00000100
 #define OTG_GUSBCFG_HNPCAP		0x00000200
 #define OTG_GUSBCFG_TRDT_MASK		(0xf << 10)
+#define OTG_GUSBCFG_TRDT_SHIFT		10
 #define OTG_GUSBCFG_NPTXRWEN		0x00004000
 #define OTG_GUSBCFG_FHMOD		0x20000000
 #define OTG_GUSBCFG_FDMOD		0x40000000
 #define OTG_GUSBCFG_CTXPKT		0x80000000
 #define OTG_GUSBCFG_PHYSEL		(1 << 6)
+#define OTG_GUSBCFG_ULPIFSLS		(1 << 17)
+#define OTG_GUSBCFG_ULPIEVBUSD		(1 << 20)
+#define OTG_GUSBCFG_ULPIEVBUSI		(1 << 21)
+#define OTG_GUSBCFG_TSDPS		(1 << 22)
 
 /* OTG reset register (OTG_GRSTCTL) */
 #define OTG_GRSTCTL_AHBIDL		(1 << 31)
@@ -255,6 +270,10 @@
 
 /* OTG device status register (OTG_DSTS) */
 #define OTG_DSTS_SUSPSTS	(1 << 0)
+#define OTG_DSTS_ENUMSPD_MASK	(0x3 << 1)
+#define OTG_DSTS_ENUMSPD_HS	(0x0 << 1)
+#define OTG_DSTS_ENUMSPD_FS_ULPI	(0x1 << 1)
+#define OTG_DSTS_ENUMSPD_FS	(0x3 << 1)
 
 /* OTG Device IN Endpoint Common Interrupt Mask Register (OTG_DIEPMSK) */
 /* Bits 31:10 - Reserved */
@@ -356,6 +375,11 @@
 /* Bits 18:7 - Reserved */
 #define OTG_DIEPSIZ0_XFRSIZ_MASK	(0x7f << 0)
 
+/* OTG Device IN/OUT Endpoint x Transfer Size Register (OTG_DxEPTSIZx) */
+#define OTG_DIEPSIZX_PKTCNT_SHIFT	19
+#define OTG_DIEPSIZX_PKTCNT_MASK	(0x3ff << 19)
+#define OTG_DIEPSIZX_XFRSIZ_MASK	(0x7ffff << 0)
+
 
 
 /* Host-mode CSRs */
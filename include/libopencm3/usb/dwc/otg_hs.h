@@ -45,8 +45,6 @@
 #define OTG_DEACHHINTMSK	0x83C
 #define OTG_DIEPEACHMSK1	0x844
 #define OTG_DOEPEACHMSK1	0x884
-#define OTG_DIEPDMA(x)		(0x914 + 0x20*(x))
-#define OTG_DOEPDMA(x)		(0xB14 + 0x20*(x))
 
 
 
@@ -78,6 +78,17 @@ typedef struct _usbd_mass_storage usbd_mass_storage;
 #define USB_MSC_REQ_BULK_ONLY_RESET	0xFF
 #define USB_MSC_REQ_GET_MAX_LUN		0xFE
 
+/* Status of a block access, returned by the block callbacks or passed to
+ * usb_msc_media_done(). Any other non-zero value is a medium error.
+ */
+enum usb_msc_media_status {
+	USB_MSC_MEDIA_OK = 0,
+	USB_MSC_MEDIA_ERROR = 1,
+	USB_MSC_MEDIA_NOT_PRESENT = 2,
+	USB_MSC_MEDIA_WRITE_PROTECTED = 3,
+	USB_MSC_MEDIA_OUT_OF_RANGE = 4,
+};
+
 usbd_mass_storage *usb_msc_init(usbd_device *usbd_dev,
 				 uint8_t ep_in, uint8_t ep_in_size,
 				 uint8_t ep_out, uint8_t ep_out_size,
@@ -88,6 +99,27 @@ usbd_mass_storage *usb_msc_init(usbd_device *usbd_dev,
 				 int (*read_block)(uint32_t lba, uint8_t *copy_to),
 				 int (*write_block)(uint32_t lba, const uint8_t *copy_from));
 
+void usb_msc_set_block_callbacks(usbd_mass_storage *ms,
+				 int (*read_blocks)(uint32_t lba,
+						    uint8_t *copy_to,
+						    uint32_t count),
+				 int (*write_blocks)(uint32_t lba,
+						     const uint8_t *copy_from,
+						     uint32_t count));
+int usb_msc_set_buffer(usbd_mass_storage *ms, uint8_t *buf, uint32_t len);
+void usb_msc_set_async_callbacks(usbd_mass_storage *ms,
+				 void (*start_read)(uint32_t lba,
+						    uint8_t *copy_to,
+						    uint32_t count),
+				 void (*start_write)(uint32_t lba,
+						     const uint8_t *copy_from,
+						     uint32_t count));
+void usb_msc_media_done(usbd_mass_storage *ms, int status);
+int usb_msc_set_write_cache(usbd_mass_storage *ms, uint8_t *buf, uint32_t len,
+			    uint16_t timeout);
+void usb_msc_cache_tick(usbd_mass_storage *ms);
+int usb_msc_cache_flush(usbd_mass_storage *ms);
+
 #endif
 
 /**@}*/
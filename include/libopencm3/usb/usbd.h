@@ -52,12 +52,24 @@ enum usbd_request_return_codes {
 typedef struct _usbd_driver usbd_driver;
 typedef struct _usbd_device usbd_device;
 
+/** Bus speed negotiated at the last USB reset */
+enum usbd_speed {
+	USBD_SPEED_FULL	= 0,
+	USBD_SPEED_HIGH	= 1,
+};
+
 extern const usbd_driver st_usbfs_v1_usb_driver;
 extern const usbd_driver stm32f107_usb_driver;
 extern const usbd_driver stm32f207_usb_driver;
+extern const usbd_driver stm32f207_dma_usb_driver;
+extern const usbd_driver stm32f207_hs_usb_driver;
+extern const usbd_driver stm32f207_hs_dma_usb_driver;
 extern const usbd_driver st_usbfs_v2_usb_driver;
 #define otgfs_usb_driver stm32f107_usb_driver
 #define otghs_usb_driver stm32f207_usb_driver
+#define otghs_dma_usb_driver stm32f207_dma_usb_driver
+#define otghs_ulpi_usb_driver stm32f207_hs_usb_driver
+#define otghs_ulpi_dma_usb_driver stm32f207_hs_dma_usb_driver
 extern const usbd_driver efm32lg_usb_driver;
 extern const usbd_driver efm32hg_usb_driver;
 extern const usbd_driver lm4f_usb_driver;
@@ -130,6 +142,9 @@ typedef void (*usbd_set_altsetting_callback)(usbd_device *usbd_dev,
 
 typedef void (*usbd_endpoint_callback)(usbd_device *usbd_dev, uint8_t ep);
 
+typedef void (*usbd_transfer_callback)(usbd_device *usbd_dev, uint8_t addr,
+				       uint32_t len);
+
 /* <usb_control.c> */
 /** Registers a control callback.
  *
@@ -165,6 +180,22 @@ extern int usbd_register_set_config_callback(usbd_device *usbd_dev,
 extern void usbd_register_set_altsetting_callback(usbd_device *usbd_dev,
 					usbd_set_altsetting_callback callback);
 
+/** Serve configuration descriptors from a prebuilt copy
+ *
+ * Every configuration is serialized once into buf, back to back, and
+ * GET_DESCRIPTOR(CONFIGURATION) requests are then answered straight from it
+ * instead of being assembled in the control buffer each time. The control
+ * buffer no longer needs to hold the largest configuration. Devices that can
+ * run at high speed rebuild the copy when the bus speed changes.
+ * @param usbd_dev the usb device handle returned from @ref usbd_init
+ * @param buf space for all configuration descriptors, must stay valid
+ * @param len size of buf
+ * @return 0 if successful, -1 if buf is too small; descriptors are then
+ * still built on every request.
+ */
+extern int usbd_register_config_cache(usbd_device *usbd_dev, uint8_t *buf,
+				      uint16_t len);
+
 /** Registers a non-contiguous string descriptor */
 extern void usbd_register_extra_string(usbd_device *usbd_dev, int index, const char* string);
 
@@ -181,17 +212,41 @@ extern void usbd_poll(usbd_device *usbd_dev);
  */
 extern void usbd_disconnect(usbd_device *usbd_dev, bool disconnected);
 
+/** Bus speed the device runs at
+ *
+ * Only the OTG_HS driver with an ULPI PHY (@ref otghs_ulpi_usb_driver) can
+ * run at high speed, all others always report full speed.
+ * @param usbd_dev the usb device handle returned from @ref usbd_init
+ */
+extern enum usbd_speed usbd_get_speed(usbd_device *usbd_dev);
+
+/**
+ * Flag for the type argument of @ref usbd_ep_setup: use two packet buffers,
+ * so the hardware can move the next packet while firmware handles the
+ * current one. Only meaningful for bulk and isochronous endpoints, which
+ * then become unidirectional. Drivers without support ignore it.
+ */
+#define USBD_EP_DOUBLE_BUFFER	0x80
+
 /** Setup an endpoint
  * @param usbd_dev the usb device handle returned from @ref usbd_init
  * @param addr Full EP address including direction (e.g. 0x01 or 0x81)
- * @param type Value for bmAttributes (USB_ENDPOINT_ATTR_*)
+ * @param type Value for bmAttributes (USB_ENDPOINT_ATTR_*), optionally
+ * ORed with @ref USBD_EP_DOUBLE_BUFFER
  * @param max_size Endpoint max size
  * @param callback your desired callback function
+ * @return 0 on success, -1 if the driver ran out of buffer memory for the
+ * endpoint, which is then left disabled. In DMA mode the OTG_HS driver only
+ * takes endpoints 0..3.
  * @note The stack only supports 8 endpoints, 0..7, so don't try
  * and use arbitrary addresses here, even though USB itself would allow this.
  * Not all backends support arbitrary addressing anyway.
+ * @note On st_usbfs, setting up an endpoint again, e.g. on an alternate
+ * setting change, releases the packet memory it held before.
+ * @note Bulk endpoints are set up, and described to the host, with the size
+ * the bus speed demands: 512 bytes at high speed, at most 64 at full speed.
  */
-extern void usbd_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
+extern int usbd_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 		uint16_t max_size, usbd_endpoint_callback callback);
 
 /** Write a packet
@@ -235,6 +290,50 @@ extern uint8_t usbd_ep_stall_get(usbd_device *usbd_dev, uint8_t addr);
  */
 extern void usbd_ep_nak_set(usbd_device *usbd_dev, uint8_t addr, uint8_t nak);
 
+/* <usb_transfer.c> */
+/** Queue a multi-packet transfer on an endpoint
+ *
+ * The buffer is split into packets which are written to (IN) or read from
+ * (OUT) the endpoint as each packet completes, without a round trip through
+ * the endpoint callback. An OUT transfer ends after len bytes or on a short
+ * packet, so len should be a multiple of the endpoint size. The endpoint
+ * callback given to @ref usbd_ep_setup takes over again once the transfer
+ * is done.
+ *
+ * Once an OUT transfer is done the endpoint NAKs until the next OUT transfer
+ * is queued, so a slow consumer holds the host off instead of losing data.
+ * Clear it with @ref usbd_ep_nak_set to go back to the endpoint callback.
+ *
+ * With @ref otghs_dma_usb_driver a word aligned buffer is moved by the DMA
+ * engine of the core in one go. OUT transfers also need len to be a multiple
+ * of the endpoint size; other buffers take the packet path.
+ *
+ * May be called from thread context as well as from the USB interrupt,
+ * interrupts are masked while the transfer is queued.
+ * @param usbd_dev the usb device handle returned from @ref usbd_init
+ * @param addr Full EP address (with direction bit), not EP0
+ * @param buf data to send or space for the data received, must stay valid
+ * until the transfer completes
+ * @param len # of bytes
+ * @param zlp if true, an IN transfer of a multiple of the endpoint size is
+ * terminated with a zero length packet. An empty IN transfer always sends one.
+ * @param callback called once with the # of bytes moved, may be NULL
+ * @return 0 if queued, -1 if the endpoint is busy with another transfer or
+ * has not been set up
+ */
+extern int usbd_ep_transfer(usbd_device *usbd_dev, uint8_t addr, void *buf,
+			    uint32_t len, bool zlp,
+			    usbd_transfer_callback callback);
+
+/** Drop the transfer queued on an endpoint, without calling its callback
+ * @param usbd_dev the usb device handle returned from @ref usbd_init
+ * @param addr Full EP address (with direction bit)
+ * @note A packet already handed to the hardware is still sent. A transfer
+ * handed to the DMA engine is stopped, data it already moved is lost.
+ * Like @ref usbd_ep_transfer it may be called from thread context.
+ */
+extern void usbd_ep_transfer_cancel(usbd_device *usbd_dev, uint8_t addr);
+
 END_DECLS
 
 #endif
@@ -140,7 +140,7 @@ struct usb_device_descriptor {
 #define USB_DT_DEVICE_SIZE sizeof(struct usb_device_descriptor)
 
 /* USB Device_Qualifier Descriptor - Table 9-9
- * Not used in this implementation.
+ * Built from the device descriptor by devices that can run at high speed.
  */
 struct usb_device_qualifier_descriptor {
 	uint8_t bLength;
@@ -153,6 +153,8 @@ struct usb_device_qualifier_descriptor {
 	uint8_t bNumConfigurations;
 	uint8_t bReserved;
 } __attribute__((packed));
+#define USB_DT_DEVICE_QUALIFIER_SIZE \
+	sizeof(struct usb_device_qualifier_descriptor)
 
 /* This is only defined as a top level named struct to improve c++
  * compatibility.  You should never need to instance this struct
@@ -0,0 +1,413 @@
+/** @addtogroup adc_file ADC peripheral API
+@ingroup peripheral_apis
+
+@brief <b>libopencm3 GD32F1x0 Analog to Digital Converter</b>
+
+The GD32F1x0 has a single A/D converter, ADC1, with the register layout of the
+STM32F1 ADC. Channels 16 and 17 are internally connected to the temperature
+sensor and V<sub>REFINT</sub>. The ADC clock is prescaled from the APB2 clock
+and must not exceed 14MHz.
+
+Besides the basic API this file provides continuous scanning into a ping-pong
+buffer. @ref adc_setup_scan programs a scan sequence and
+@ref adc_start_continuous_dma starts converting it over and over, with DMA1
+channel 1 in circular mode storing the samples. The DMA raises an interrupt
+when either half of the buffer has been filled, which has to be enabled in the
+NVIC (dma_channel1) and forwarded to @ref adc_dma_isr. The callback is then
+given the half that just completed, while the other half is being filled.
+There is no interrupt per sample, so with a 14MHz ADC clock and the shortest
+sample time the ADC delivers 1 Msps.
+
+@section adc_api_ex Basic ADC Handling API.
+
+Example: Four channels scanned continuously into two halves of 64 scans.
+
+@code
+	static uint16_t samples[2 * 64 * 4];
+	static const uint8_t channels[] = { 0, 1, 2, 3 };
+
+	rcc_periph_clock_enable(RCC_ADC);
+	rcc_periph_clock_enable(RCC_DMA);
+	adc_power_off(ADC1);
+	adc_setup_scan(ADC1, 4, channels, ADC_SMPR_SMP_1DOT5CYC);
+	adc_power_on(ADC1);
+	adc_reset_calibration(ADC1);
+	adc_calibrate(ADC1);
+	nvic_enable_irq(NVIC_DMA_CHANNEL1_IRQ);
+	adc_start_continuous_dma(ADC1, samples, sizeof(samples) / 2, process);
+@endcode
+
+LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <libopencm3/gd32/adc.h>
+#include <libopencm3/gd32/dma.h>
+
+static void (*adc_dma_callback)(uint16_t *samples, uint16_t count);
+static uint16_t *adc_dma_buffer;
+static uint16_t adc_dma_half;
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Power On
+
+If the ADC is in power-down mode then it is powered up. The application needs
+to wait a time of about 3 microseconds for stabilization before using the ADC.
+If the ADC is already on this function call has no effect.
+
+@param[in] adc Unsigned int32. ADC block register address base @ref adc_reg_base
+*/
+
+void adc_power_on(uint32_t adc)
+{
+	if (!(ADC_CR2(adc) & ADC_CR2_ADON)) {
+		ADC_CR2(adc) |= ADC_CR2_ADON;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Start a Conversion Without Trigger
+
+This initiates a conversion by software without a trigger. The ADC needs to be
+powered on before this is called, otherwise this function has no effect.
+
+@param[in] adc Unsigned int32. ADC block register address base @ref adc_reg_base
+*/
+
+void adc_start_conversion_direct(uint32_t adc)
+{
+	if (ADC_CR2(adc) & ADC_CR2_ADON) {
+		ADC_CR2(adc) |= ADC_CR2_ADON;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Enable The Temperature Sensor
+
+This enables both the sensor and the reference voltage measurements on channels
+16 and 17.
+*/
+
+void adc_enable_temperature_sensor(void)
+{
+	ADC_CR2(ADC1) |= ADC_CR2_TSVREFE;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Disable The Temperature Sensor
+
+Disabling this will reduce power consumption from the sensor and the reference
+voltage measurements.
+*/
+
+void adc_disable_temperature_sensor(void)
+{
+	ADC_CR2(ADC1) &= ~ADC_CR2_TSVREFE;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Enable an External Trigger for Regular Channels
+
+@param[in] adc Unsigned int32. ADC block register address base @ref
+adc_reg_base.
+@param[in] trigger Unsigned int32. Trigger identifier @ref adc_trigger_regular
+*/
+
+void adc_enable_external_trigger_regular(uint32_t adc, uint32_t trigger)
+{
+	uint32_t reg32;
+
+	reg32 = (ADC_CR2(adc) & ~(ADC_CR2_EXTSEL_MASK));
+	reg32 |= (trigger);
+	ADC_CR2(adc) = reg32;
+	ADC_CR2(adc) |= ADC_CR2_EXTTRIG;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Disable an External Trigger for Regular Channels
+
+@param[in] adc Unsigned int32. ADC block register address base @ref
+adc_reg_base.
+*/
+
+void adc_disable_external_trigger_regular(uint32_t adc)
+{
+	ADC_CR2(adc) &= ~ADC_CR2_EXTTRIG;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Enable an External Trigger for Injected Channels
+
+@param[in] adc Unsigned int32. ADC block register address base @ref
+adc_reg_base.
+@param[in] trigger Unsigned int32. Trigger identifier @ref
+adc_trigger_injected
+*/
+
+void adc_enable_external_trigger_injected(uint32_t adc, uint32_t trigger)
+{
+	uint32_t reg32;
+
+	reg32 = (ADC_CR2(adc) & ~(ADC_CR2_JEXTSEL_MASK));
+	reg32 |= (trigger);
+	ADC_CR2(adc) = reg32;
+	ADC_CR2(adc) |= ADC_CR2_JEXTTRIG;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Disable an External Trigger for Injected Channels
+
+@param[in] adc Unsigned int32. ADC block register address base @ref
+adc_reg_base.
+*/
+
+void adc_disable_external_trigger_injected(uint32_t adc)
+{
+	ADC_CR2(adc) &= ~ADC_CR2_JEXTTRIG;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Initialize Calibration Registers
+
+@param[in] adc Unsigned int32. ADC block register address base @ref
+adc_reg_base.
+*/
+
+void adc_reset_calibration(uint32_t adc)
+{
+	ADC_CR2(adc) |= ADC_CR2_RSTCAL;
+	while (ADC_CR2(adc) & ADC_CR2_RSTCAL);
+}
+
+/**
+ * Start the ADC calibration and immediately return.
+ * @sa adc_calibrate
+ * @sa adc_is_calibrating
+ * @param adc ADC Block register address base @ref adc_reg_base
+ */
+void adc_calibrate_async(uint32_t adc)
+{
+	ADC_CR2(adc) |= ADC_CR2_CAL;
+}
+
+/**
+ * Is the ADC Calibrating?
+ * @param adc ADC Block register address base @ref adc_reg_base
+ * @return true if the adc is currently calibrating
+ */
+bool adc_is_calibrating(uint32_t adc)
+{
+	return (ADC_CR2(adc) & ADC_CR2_CAL);
+}
+
+/**
+ * Start ADC calibration and wait for it to finish.
+ * The ADC must have been powered down for at least 2 ADC clock cycles, then
+ * powered on before calibration starts
+ * @param adc ADC Block register address base @ref adc_reg_base
+ */
+void adc_calibrate(uint32_t adc)
+{
+	adc_calibrate_async(adc);
+	while (adc_is_calibrating(adc));
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Set the Sample Time for a Single Channel
+
+The sampling time can be selected in ADC clock cycles from 1.5 to 239.5.
+
+@param[in] adc Unsigned int32. ADC block register address base @ref
+adc_reg_base.
+@param[in] channel Unsigned int8. ADC Channel integer 0..17 or from @ref
+adc_channel.
+@param[in] time Unsigned int8. Sampling time selection from @ref adc_sample_rg.
+*/
+
+void adc_set_sample_time(uint32_t adc, uint8_t channel, uint8_t time)
+{
+	uint32_t reg32;
+
+	if (channel < 10) {
+		reg32 = ADC_SMPR2(adc);
+		reg32 &= ~(0x7 << (channel * 3));
+		reg32 |= (time << (channel * 3));
+		ADC_SMPR2(adc) = reg32;
+	} else {
+		reg32 = ADC_SMPR1(adc);
+		reg32 &= ~(0x7 << ((channel - 10) * 3));
+		reg32 |= (time << ((channel - 10) * 3));
+		ADC_SMPR1(adc) = reg32;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Set the Sample Time for All Channels
+
+The sampling time can be selected in ADC clock cycles from 1.5 to 239.5, same
+for all channels.
+
+@param[in] adc Unsigned int32. ADC block register address base @ref
+adc_reg_base.
+@param[in] time Unsigned int8. Sampling time selection from @ref adc_sample_rg.
+*/
+
+void adc_set_sample_time_on_all_channels(uint32_t adc, uint8_t time)
+{
+	uint8_t i;
+	uint32_t reg32 = 0;
+
+	for (i = 0; i <= 9; i++) {
+		reg32 |= (time << (i * 3));
+	}
+	ADC_SMPR2(adc) = reg32;
+
+	reg32 = 0;
+	for (i = 10; i <= 17; i++) {
+		reg32 |= (time << ((i - 10) * 3));
+	}
+	ADC_SMPR1(adc) = reg32;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Set Up a Scan Sequence
+
+Programs the regular sequence, gives every channel in it the same sample time
+and enables scan mode. The sequence and sample time registers are each written
+once. The ADC must not be converting.
+
+@param[in] adc Unsigned int32. ADC block register address base @ref
+adc_reg_base.
+@param[in] length Unsigned int8. Number of channels in the sequence, 1..16.
+@param[in] channel Unsigned int8 array. Channels in the order of conversion.
+@param[in] time Unsigned int8. Sampling time selection from @ref adc_sample_rg.
+*/
+
+void adc_setup_scan(uint32_t adc, uint8_t length, const uint8_t channel[],
+		    uint8_t time)
+{
+	uint32_t sqr[3] = { 0, 0, 0 };
+	uint32_t smpr_mask[2] = { 0, 0 };
+	uint32_t smpr[2] = { 0, 0 };
+	uint8_t i;
+
+	if (length == 0 || length > ADC_SQR_MAX_CHANNELS_REGULAR) {
+		return;
+	}
+
+	for (i = 0; i < length; i++) {
+		uint8_t ch = channel[i];
+		uint8_t reg = (ch < 10) ? 1 : 0;
+		uint8_t shift = ((ch < 10) ? ch : ch - 10) * 3;
+
+		sqr[i / 6] |= ch << ((i % 6) * 5);
+		smpr_mask[reg] |= 0x7 << shift;
+		smpr[reg] |= time << shift;
+	}
+
+	ADC_SQR3(adc) = sqr[0];
+	ADC_SQR2(adc) = sqr[1];
+	ADC_SQR1(adc) = sqr[2] | ((length - 1) << ADC_SQR1_L_LSB);
+	ADC_SMPR1(adc) = (ADC_SMPR1(adc) & ~smpr_mask[0]) | smpr[0];
+	ADC_SMPR2(adc) = (ADC_SMPR2(adc) & ~smpr_mask[1]) | smpr[1];
+	ADC_CR1(adc) |= ADC_CR1_SCAN;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Start Continuous Conversion into a Ping-Pong Buffer
+
+Starts converting the regular sequence back to back, with every result stored
+into @p buffer by DMA1 channel 1 in circular mode. Each time a half of the
+buffer is full, @ref adc_dma_isr passes it to @p callback, which has to be
+done with it before the DMA wraps around to it again.
+
+For the halves to hold whole scans, @p len should be a multiple of twice the
+sequence length. The ADC has to be powered on and calibrated.
+
+@param[in] adc Unsigned int32. ADC block register address base @ref
+adc_reg_base.
+@param[in] buffer Sample buffer.
+@param[in] len Number of samples in @p buffer, even.
+@param[in] callback Called with each completed half and its sample count.
+*/
+
+void adc_start_continuous_dma(uint32_t adc, uint16_t *buffer, uint16_t len,
+			      void (*callback)(uint16_t *samples,
+					       uint16_t count))
+{
+	struct dma_transfer xfer;
+
+	adc_dma_callback = callback;
+	adc_dma_buffer = buffer;
+	adc_dma_half = len / 2;
+
+	xfer.peripheral_address = (uint32_t)&ADC_DR(adc);
+	xfer.memory_address = (uint32_t)buffer;
+	xfer.number = len;
+	xfer.ccr = DMA_CCR_MSIZE_16BIT | DMA_CCR_PSIZE_16BIT | DMA_CCR_MINC |
+		   DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE |
+		   DMA_CCR_PL_VERY_HIGH;
+	dma_start_transfer(DMA1, ADC1_DMA_CHANNEL, &xfer);
+
+	ADC_CR2(adc) |= ADC_CR2_DMA | ADC_CR2_CONT;
+	adc_enable_external_trigger_regular(adc, ADC_CR2_EXTSEL_SWSTART);
+	ADC_CR2(adc) |= ADC_CR2_SWSTART;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC Stop Continuous Conversion
+
+@param[in] adc Unsigned int32. ADC block register address base @ref
+adc_reg_base.
+*/
+
+void adc_stop_continuous_dma(uint32_t adc)
+{
+	ADC_CR2(adc) &= ~(ADC_CR2_CONT | ADC_CR2_DMA);
+	DMA_CCR(DMA1, ADC1_DMA_CHANNEL) = 0;
+	DMA_IFCR(DMA1) = DMA_IFCR_CIF(ADC1_DMA_CHANNEL);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC DMA Interrupt Handler
+
+To be called from the dma_channel1 interrupt. If the handler was late and both
+halves are complete, they are passed to the callback in order.
+*/
+
+void adc_dma_isr(void)
+{
+	if (dma_get_interrupt_flag(DMA1, ADC1_DMA_CHANNEL, DMA_HTIF)) {
+		dma_clear_interrupt_flags(DMA1, ADC1_DMA_CHANNEL, DMA_HTIF);
+		if (adc_dma_callback) {
+			adc_dma_callback(adc_dma_buffer, adc_dma_half);
+		}
+	}
+
+	if (dma_get_interrupt_flag(DMA1, ADC1_DMA_CHANNEL, DMA_TCIF)) {
+		dma_clear_interrupt_flags(DMA1, ADC1_DMA_CHANNEL, DMA_TCIF);
+		if (adc_dma_callback) {
+			adc_dma_callback(adc_dma_buffer + adc_dma_half,
+					 adc_dma_half);
+		}
+	}
+}
+
+/**@}*/
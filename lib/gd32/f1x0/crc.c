@@ -0,0 +1,162 @@
+/** @addtogroup crc_file
+
+@brief <b>libopencm3 GD32F1x0 CRC DMA block checksums</b>
+
+The CRC unit has no DMA request of its own, but a DMA1 channel in memory to
+memory mode can feed it a block of words much faster than the
+@ref crc_calculate_block loop, and without the CPU.
+
+The unit only accepts whole words. Trailing bytes are folded into the result
+in software by @ref crc_calculate_tail, with the same MSB first polynomial, as
+the unit would if it took byte writes. @ref crc_calculate_bytes combines both
+for a buffer of any length.
+
+LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <libopencm3/gd32/crc.h>
+#include <libopencm3/gd32/dma.h>
+
+/*---------------------------------------------------------------------------*/
+/** @brief CRC Start Feeding a Block by DMA
+
+Adds the words to the running CRC without resetting it. The DMA1 clock has to
+be enabled and the channel must not be in use.
+
+@param[in] channel DMA1 channel to use, 1..7.
+@param[in] datap Word aligned block of 32 bit data words.
+@param[in] size Number of words.
+*/
+
+void crc_calculate_block_dma_start(uint8_t channel, const uint32_t *datap,
+				   uint16_t size)
+{
+	struct dma_transfer xfer;
+
+	xfer.peripheral_address = (uint32_t)&CRC_DR;
+	xfer.memory_address = (uint32_t)datap;
+	xfer.number = size;
+	xfer.ccr = DMA_CCR_MEM2MEM | DMA_CCR_DIR | DMA_CCR_MINC |
+		   DMA_CCR_MSIZE_32BIT | DMA_CCR_PSIZE_32BIT |
+		   DMA_CCR_PL_LOW;
+	dma_start_transfer(DMA1, channel, &xfer);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief CRC Check for the End of a DMA Block
+
+Once this returns true, CRC_DR holds the result and the channel is free.
+
+@param[in] channel DMA1 channel given to @ref crc_calculate_block_dma_start.
+@returns true when all words have been fed to the CRC unit.
+*/
+
+bool crc_calculate_block_dma_done(uint8_t channel)
+{
+	if (!dma_get_interrupt_flag(DMA1, channel, DMA_TCIF)) {
+		return false;
+	}
+
+	DMA_CCR(DMA1, channel) = 0;
+	DMA_IFCR(DMA1) = DMA_IFCR_CIF(channel);
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief CRC Add a Block by DMA and Wait for the Result
+
+@param[in] channel DMA1 channel to use, 1..7.
+@param[in] datap Word aligned block of 32 bit data words.
+@param[in] size Number of words.
+@returns final CRC calculator value
+*/
+
+uint32_t crc_calculate_block_dma(uint8_t channel, const uint32_t *datap,
+				 uint16_t size)
+{
+	if (size) {
+		crc_calculate_block_dma_start(channel, datap, size);
+		while (!crc_calculate_block_dma_done(channel));
+	}
+
+	return CRC_DR;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief CRC Add Trailing Bytes in Software
+
+Continues @p crc over up to a few bytes, which the CRC unit can not take. The
+result is not written back to the unit, so it has to be the last step.
+
+@param[in] crc Running CRC, usually the value of CRC_DR.
+@param[in] data Bytes to add.
+@param[in] len Number of bytes.
+@returns CRC including the bytes
+*/
+
+uint32_t crc_calculate_tail(uint32_t crc, const uint8_t *data, int len)
+{
+	int i, bit;
+
+	for (i = 0; i < len; i++) {
+		crc ^= (uint32_t)data[i] << 24;
+		for (bit = 0; bit < 8; bit++) {
+			if (crc & 0x80000000) {
+				crc = (crc << 1) ^ CRC_POLYNOMIAL;
+			} else {
+				crc <<= 1;
+			}
+		}
+	}
+
+	return crc;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief CRC Checksum a Buffer of Any Length
+
+Whole words are fed by DMA, 65535 at a time, and the remaining bytes are
+added by @ref crc_calculate_tail. The running CRC is not reset first.
+
+@param[in] channel DMA1 channel to use, 1..7.
+@param[in] data Word aligned buffer.
+@param[in] len Length of the buffer in bytes.
+@returns final CRC value
+*/
+
+uint32_t crc_calculate_bytes(uint8_t channel, const uint8_t *data,
+			     uint32_t len)
+{
+	const uint32_t *words = (const uint32_t *)data;
+	uint32_t count = len / 4;
+	uint16_t chunk;
+
+	while (count) {
+		chunk = (count > 0xffff) ? 0xffff : count;
+		crc_calculate_block_dma(channel, words, chunk);
+		words += chunk;
+		count -= chunk;
+	}
+
+	return crc_calculate_tail(CRC_DR, (const uint8_t *)words, len % 4);
+}
+
+/**@}*/
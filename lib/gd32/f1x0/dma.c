@@ -0,0 +1,58 @@
+/** @addtogroup dma_file DMA peripheral API
+
+@brief <b>libopencm3 GD32F1x0 DMA</b>
+
+The GD32F1x0 has a single DMA controller with 7 channels, register compatible
+with the STM32F0/F1 one. On top of the common channel API a transfer can be
+described once in a const @ref dma_transfer and started with a single call.
+
+LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <libopencm3/gd32/dma.h>
+
+/*---------------------------------------------------------------------------*/
+/** @brief DMA Configure and Start a Transfer
+
+The channel is disabled, its interrupt flags are cleared, and the addresses,
+transfer count and configuration are written straight from the descriptor
+before the channel is enabled again. This replaces the sequence of
+read-modify-write calls otherwise needed to set up each transfer.
+
+@param[in] dma unsigned int32. DMA controller base address: DMA1
+@param[in] channel unsigned int8. Channel number: @ref dma_ch
+@param[in] xfer Transfer descriptor. The ccr field holds the logical OR of the
+DMA_CCR_* bits wanted, DMA_CCR_EN is added here.
+*/
+
+void dma_start_transfer(uint32_t dma, uint8_t channel,
+			const struct dma_transfer *xfer)
+{
+	DMA_CCR(dma, channel) = 0;
+	DMA_IFCR(dma) = DMA_IFCR_CIF(channel);
+	DMA_CPAR(dma, channel) = xfer->peripheral_address;
+	DMA_CMAR(dma, channel) = xfer->memory_address;
+	DMA_CNDTR(dma, channel) = xfer->number;
+	DMA_CCR(dma, channel) = xfer->ccr | DMA_CCR_EN;
+}
+
+/**@}*/
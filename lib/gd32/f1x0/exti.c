@@ -0,0 +1,90 @@
+/** @addtogroup exti_file
+
+@brief <b>libopencm3 GD32F1x0 EXTI dispatcher</b>
+
+The sixteen GPIO lines share three interrupt vectors, exti0_1, exti2_3 and
+exti4_15. @ref exti_dispatch demultiplexes one of them in a single pass: it
+acknowledges all of its pending lines with one write, then walks the set bits
+with count trailing zeros and calls the callback registered for each line with
+@ref exti_set_callback. The cost is per pending line, not per line sharing the
+vector.
+
+@code
+	void exti4_15_isr(void)
+	{
+		exti_dispatch(EXTI4_15_LINES);
+	}
+@endcode
+
+LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <libopencm3/gd32/exti.h>
+
+static void (*exti_callbacks[EXTI_GPIO_LINES])(uint8_t line);
+
+/*---------------------------------------------------------------------------*/
+/** @brief EXTI Set the Callback of a Line
+
+The line still has to be routed, given a trigger and enabled with the common
+EXTI API, and its vector enabled in the NVIC.
+
+@param[in] line GPIO line number, 0..15.
+@param[in] callback Called from @ref exti_dispatch, or NULL to remove it.
+*/
+
+void exti_set_callback(uint8_t line, void (*callback)(uint8_t line))
+{
+	if (line < EXTI_GPIO_LINES) {
+		exti_callbacks[line] = callback;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief EXTI Dispatch the Pending Lines of a Vector
+
+To be called from exti0_1_isr, exti2_3_isr or exti4_15_isr with the matching
+EXTIx_y_LINES mask. Lines are handled in ascending order. An edge arriving
+while the callbacks run pends the line again.
+
+@param[in] extis Lines sharing the vector, ORed EXTIx values.
+*/
+
+void exti_dispatch(uint32_t extis)
+{
+	uint32_t pending = EXTI_PR & EXTI_IMR & extis & 0xffff;
+	void (*callback)(uint8_t line);
+	uint8_t line;
+
+	EXTI_PR = pending;
+
+	while (pending) {
+		line = __builtin_ctz(pending);
+		pending &= pending - 1;
+
+		callback = exti_callbacks[line];
+		if (callback) {
+			callback(line);
+		}
+	}
+}
+
+/**@}*/
@@ -130,6 +130,102 @@ void flash_erase_page(uint32_t page_address)
 	FLASH_CR &= ~FLASH_CR_PER;
 }
 
+/*---------------------------------------------------------------------------*/
+/** @brief Program a Buffer to FLASH
+
+This programs an arbitrary amount of data with the PG bit kept set for the
+whole buffer. The GD32F1x0 FMC accepts 32 bit word writes, so the data is
+written a word at a time, with half word writes only to reach word alignment
+at the start and for the tail. An odd trailing byte is padded with 0xff.
+
+Stale error flags are cleared first. Programming stops at the first programming
+or write protection error, the status flags should be checked afterwards with
+@ref flash_get_status_flags.
+
+@param[in] address Full address of the first half word to program, must be
+half word aligned.
+@param[in] data Data to program, no alignment requirement.
+@param[in] len Number of bytes to program.
+*/
+
+void flash_program_buffer(uint32_t address, const uint8_t *data, uint32_t len)
+{
+	const uint32_t errors = FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+
+	flash_wait_for_last_operation();
+	flash_clear_status_flags();
+
+	FLASH_CR |= FLASH_CR_PG;
+
+	if ((address & 2) && len) {
+		MMIO16(address) = data[0] | ((len > 1 ? data[1] : 0xff) << 8);
+		address += 2;
+		data += 2;
+		len = (len > 2) ? len - 2 : 0;
+		flash_wait_for_last_operation();
+	}
+
+	while (len >= 4 && !(FLASH_SR & errors)) {
+		MMIO32(address) = data[0] | (data[1] << 8) |
+				  (data[2] << 16) | ((uint32_t)data[3] << 24);
+		address += 4;
+		data += 4;
+		len -= 4;
+		while (FLASH_SR & FLASH_SR_BSY);
+	}
+
+	while (len && !(FLASH_SR & errors)) {
+		MMIO16(address) = data[0] | ((len > 1 ? data[1] : 0xff) << 8);
+		address += 2;
+		data += 2;
+		len = (len > 2) ? len - 2 : 0;
+		flash_wait_for_last_operation();
+	}
+
+	FLASH_CR &= ~FLASH_CR_PG;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Erase a Range of FLASH Pages
+
+This erases every page overlapping the given range, keeping the PER bit set
+while the pages are erased one after another. Erasing stops at the first
+write protection error. A zero length erases nothing.
+
+@param[in] address Full address of the start of the range.
+@param[in] len Length of the range in bytes.
+*/
+
+void flash_erase_pages(uint32_t address, uint32_t len)
+{
+	uint32_t last;
+
+	if (!len) {
+		return;
+	}
+
+	/* Last byte of the range, clipped at the top of the address space. */
+	last = (len - 1 > 0xffffffff - address) ? 0xffffffff : address + len - 1;
+	last &= ~(FLASH_PAGE_SIZE - 1);
+	address &= ~(FLASH_PAGE_SIZE - 1);
+
+	flash_wait_for_last_operation();
+	flash_clear_status_flags();
+
+	FLASH_CR |= FLASH_CR_PER;
+
+	for (;; address += FLASH_PAGE_SIZE) {
+		FLASH_AR = address;
+		FLASH_CR |= FLASH_CR_STRT;
+		flash_wait_for_last_operation();
+		if ((FLASH_SR & FLASH_SR_WRPRTERR) || address == last) {
+			break;
+		}
+	}
+
+	FLASH_CR &= ~FLASH_CR_PER;
+}
+
 /*---------------------------------------------------------------------------*/
 /** @brief Erase All FLASH
 
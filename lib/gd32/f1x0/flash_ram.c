@@ -0,0 +1,126 @@
+/** @addtogroup flash_file
+
+@brief <b>libopencm3 GD32F1x0 FLASH routines running from RAM</b>
+
+These are copies of @ref flash_program_buffer and @ref flash_erase_pages
+placed in the .ramtext section, which the startup code copies to RAM. The
+core keeps executing while the flash is busy, instead of stalling on
+instruction fetches for the whole erase or program time.
+
+Nothing called from here may live in flash, so the routines poll the FMC
+registers directly. The same holds for interrupts that should keep being
+serviced during the operation: their handlers have to be placed in .ramtext
+and the vector table relocated to RAM through SCB_VTOR, otherwise the vector
+fetch itself stalls until the flash is idle again.
+
+Both routines are long_call, as RAM is out of branch range from flash.
+
+LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <libopencm3/gd32/flash.h>
+
+#define FLASH_SR_ERRORS		(FLASH_SR_PGERR | FLASH_SR_WRPRTERR)
+
+/*---------------------------------------------------------------------------*/
+/** @brief Program a Buffer to FLASH from RAM
+
+RAM resident version of @ref flash_program_buffer, with the same arguments
+and behaviour.
+*/
+
+__attribute__ ((long_call, section (".ramtext")))
+void flash_program_buffer_ram(uint32_t address, const uint8_t *data,
+			      uint32_t len)
+{
+	while (FLASH_SR & FLASH_SR_BSY);
+	FLASH_SR = FLASH_SR_ERRORS | FLASH_SR_EOP;
+
+	FLASH_CR |= FLASH_CR_PG;
+
+	if ((address & 2) && len) {
+		MMIO16(address) = data[0] | ((len > 1 ? data[1] : 0xff) << 8);
+		address += 2;
+		data += 2;
+		len = (len > 2) ? len - 2 : 0;
+		while (FLASH_SR & FLASH_SR_BSY);
+	}
+
+	while (len >= 4 && !(FLASH_SR & FLASH_SR_ERRORS)) {
+		MMIO32(address) = data[0] | (data[1] << 8) |
+				  (data[2] << 16) | ((uint32_t)data[3] << 24);
+		address += 4;
+		data += 4;
+		len -= 4;
+		while (FLASH_SR & FLASH_SR_BSY);
+	}
+
+	while (len && !(FLASH_SR & FLASH_SR_ERRORS)) {
+		MMIO16(address) = data[0] | ((len > 1 ? data[1] : 0xff) << 8);
+		address += 2;
+		data += 2;
+		len = (len > 2) ? len - 2 : 0;
+		while (FLASH_SR & FLASH_SR_BSY);
+	}
+
+	FLASH_CR &= ~FLASH_CR_PG;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Erase a Range of FLASH Pages from RAM
+
+RAM resident version of @ref flash_erase_pages, with the same arguments and
+behaviour.
+*/
+
+__attribute__ ((long_call, section (".ramtext")))
+void flash_erase_pages_ram(uint32_t address, uint32_t len)
+{
+	uint32_t last;
+
+	if (!len) {
+		return;
+	}
+
+	/* Last byte of the range, clipped at the top of the address space. */
+	last = (len - 1 > 0xffffffff - address) ? 0xffffffff : address + len - 1;
+	last &= ~(FLASH_PAGE_SIZE - 1);
+	address &= ~(FLASH_PAGE_SIZE - 1);
+
+	while (FLASH_SR & FLASH_SR_BSY);
+	FLASH_SR = FLASH_SR_ERRORS | FLASH_SR_EOP;
+
+	FLASH_CR |= FLASH_CR_PER;
+
+	for (;; address += FLASH_PAGE_SIZE) {
+		FLASH_AR = address;
+		FLASH_CR |= FLASH_CR_STRT;
+		while (FLASH_SR & FLASH_SR_BSY);
+		if ((FLASH_SR & FLASH_SR_WRPRTERR) || address == last) {
+			break;
+		}
+	}
+
+	FLASH_CR &= ~FLASH_CR_PER;
+}
+
+/**@}*/
@@ -0,0 +1,325 @@
+/** @addtogroup i2c_file
+
+@brief <b>libopencm3 GD32F1x0 I2C asynchronous transfers</b>
+
+Master transfers driven by the I2C event and error interrupts, so the CPU is
+not stuck in the polling loops of @ref i2c_transfer7 while the bus is busy.
+
+A transfer is started with @ref i2c_transfer7_async and returns immediately.
+It writes @p wn bytes, then reads @p rn bytes after a repeated start. Either
+part may be empty. Payloads of more than two bytes are moved by DMA1 on the
+fixed I2C request channels, shorter ones byte by byte from the interrupt.
+
+The i2cN_ev and i2cN_er interrupts have to be enabled in the NVIC and
+forwarded to @ref i2c_ev_isr and @ref i2c_er_isr. For reads of more than two
+bytes the interrupt of the RX DMA channel (dma_channel2_3 for I2C1,
+dma_channel4_5 for I2C2) has to be forwarded to @ref i2c_dma_isr as well.
+These channels are shared with SPI and USART, which can not use DMA on them
+at the same time.
+
+LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <libopencm3/gd32/dma.h>
+#include <libopencm3/gd32/i2c.h>
+
+#define I2C_SR1_ERRORS		(I2C_SR1_SMBALERT | I2C_SR1_TIMEOUT | \
+				 I2C_SR1_PECERR | I2C_SR1_OVR | I2C_SR1_AF | \
+				 I2C_SR1_ARLO | I2C_SR1_BERR)
+
+struct i2c_async {
+	const uint8_t *tx;
+	uint8_t *rx;
+	uint16_t tx_len;
+	uint16_t rx_len;
+	uint16_t tx_count;
+	uint8_t addr;
+	bool reading;
+	volatile bool busy;
+	void (*callback)(uint32_t i2c, enum i2c_transfer_status status);
+};
+
+static struct i2c_async i2c_async_state[2];
+
+static struct i2c_async *i2c_async_get(uint32_t i2c)
+{
+	return &i2c_async_state[(i2c == I2C1) ? 0 : 1];
+}
+
+static uint8_t i2c_dma_rx_channel(uint32_t i2c)
+{
+	return (i2c == I2C1) ? I2C1_DMA_RX_CHANNEL : I2C2_DMA_RX_CHANNEL;
+}
+
+static uint8_t i2c_dma_tx_channel(uint32_t i2c)
+{
+	return (i2c == I2C1) ? I2C1_DMA_TX_CHANNEL : I2C2_DMA_TX_CHANNEL;
+}
+
+static void i2c_async_start_dma(uint32_t i2c, struct i2c_async *t)
+{
+	struct dma_transfer xfer;
+
+	xfer.peripheral_address = (uint32_t)&I2C_DR(i2c);
+	if (t->reading) {
+		xfer.memory_address = (uint32_t)t->rx;
+		xfer.number = t->rx_len;
+		xfer.ccr = DMA_CCR_MSIZE_8BIT | DMA_CCR_PSIZE_8BIT |
+			   DMA_CCR_MINC | DMA_CCR_TCIE | DMA_CCR_PL_HIGH;
+		dma_start_transfer(DMA1, i2c_dma_rx_channel(i2c), &xfer);
+		/* NACK the last byte on our own. */
+		I2C_CR2(i2c) |= I2C_CR2_DMAEN | I2C_CR2_LAST;
+	} else {
+		xfer.memory_address = (uint32_t)t->tx;
+		xfer.number = t->tx_len;
+		xfer.ccr = DMA_CCR_MSIZE_8BIT | DMA_CCR_PSIZE_8BIT |
+			   DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_PL_HIGH;
+		dma_start_transfer(DMA1, i2c_dma_tx_channel(i2c), &xfer);
+		/* Completion is signalled by BTF. */
+		t->tx_count = t->tx_len;
+		I2C_CR2(i2c) |= I2C_CR2_DMAEN;
+	}
+}
+
+static void i2c_async_stop_dma(uint32_t i2c)
+{
+	uint8_t rx_channel = i2c_dma_rx_channel(i2c);
+	uint8_t tx_channel = i2c_dma_tx_channel(i2c);
+
+	I2C_CR2(i2c) &= ~(I2C_CR2_DMAEN | I2C_CR2_LAST);
+	DMA_CCR(DMA1, rx_channel) = 0;
+	DMA_CCR(DMA1, tx_channel) = 0;
+	DMA_IFCR(DMA1) = DMA_IFCR_CIF(rx_channel) | DMA_IFCR_CIF(tx_channel);
+}
+
+static void i2c_async_finish(uint32_t i2c, struct i2c_async *t,
+			     enum i2c_transfer_status status)
+{
+	I2C_CR2(i2c) &= ~(I2C_CR2_ITBUFEN | I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+	I2C_CR1(i2c) &= ~I2C_CR1_POS;
+	t->busy = false;
+	if (t->callback) {
+		t->callback(i2c, status);
+	}
+}
+
+/* All bytes are out: turn around for the read or end the transfer. */
+static void i2c_async_write_done(uint32_t i2c, struct i2c_async *t)
+{
+	I2C_CR2(i2c) &= ~(I2C_CR2_ITBUFEN | I2C_CR2_DMAEN);
+	if (t->rx_len) {
+		t->reading = true;
+		I2C_CR1(i2c) |= I2C_CR1_START;
+	} else {
+		I2C_CR1(i2c) |= I2C_CR1_STOP;
+		i2c_async_finish(i2c, t, I2C_TRANSFER_DONE);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief I2C Start an Asynchronous Transfer
+
+The I2C has to be configured and enabled. With @p wn and @p rn both zero only
+the address is sent, which can be used to probe for a device.
+
+@param[in] i2c I2C peripheral identifier @ref i2c_reg_base
+@param[in] addr 7 bit slave address.
+@param[in] w Bytes to write.
+@param[in] wn Number of bytes to write, at most 65535.
+@param[out] r Buffer for the bytes read.
+@param[in] rn Number of bytes to read, at most 65535.
+@param[in] callback Called from interrupt context when done, may be NULL.
+@returns false if a transfer is still in progress on this I2C, or a count is
+too large.
+*/
+
+bool i2c_transfer7_async(uint32_t i2c, uint8_t addr,
+			 const uint8_t *w, size_t wn, uint8_t *r, size_t rn,
+			 void (*callback)(uint32_t i2c,
+					  enum i2c_transfer_status status))
+{
+	struct i2c_async *t = i2c_async_get(i2c);
+
+	if (t->busy || wn > 0xffff || rn > 0xffff) {
+		return false;
+	}
+
+	t->tx = w;
+	t->tx_len = wn;
+	t->tx_count = 0;
+	t->rx = r;
+	t->rx_len = rn;
+	t->addr = addr;
+	t->reading = (wn == 0) && (rn != 0);
+	t->callback = callback;
+	t->busy = true;
+
+	/* The STOP of the previous transfer may still be pending. */
+	while (I2C_CR1(i2c) & I2C_CR1_STOP);
+
+	I2C_SR1(i2c) &= ~I2C_SR1_ERRORS;
+	I2C_CR2(i2c) |= I2C_CR2_ITEVTEN | I2C_CR2_ITERREN;
+	I2C_CR1(i2c) |= I2C_CR1_START;
+
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief I2C Check for a Transfer in Progress
+
+@param[in] i2c I2C peripheral identifier @ref i2c_reg_base
+@returns true until the callback of the current transfer has been called.
+*/
+
+bool i2c_transfer_busy(uint32_t i2c)
+{
+	return i2c_async_get(i2c)->busy;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief I2C Event Interrupt Handler
+
+To be called from the i2cN_ev interrupt.
+
+@param[in] i2c I2C peripheral identifier @ref i2c_reg_base
+*/
+
+void i2c_ev_isr(uint32_t i2c)
+{
+	struct i2c_async *t = i2c_async_get(i2c);
+	uint32_t sr1 = I2C_SR1(i2c);
+
+	if (!t->busy) {
+		return;
+	}
+
+	if (sr1 & I2C_SR1_SB) {
+		if (!t->reading) {
+			I2C_DR(i2c) = t->addr << 1;
+			return;
+		}
+		/* ACK and POS have to be right before ADDR is cleared. */
+		if (t->rx_len == 1) {
+			I2C_CR1(i2c) &= ~I2C_CR1_ACK;
+		} else if (t->rx_len == 2) {
+			I2C_CR1(i2c) |= I2C_CR1_ACK | I2C_CR1_POS;
+		} else {
+			I2C_CR1(i2c) |= I2C_CR1_ACK;
+		}
+		I2C_DR(i2c) = (t->addr << 1) | 1;
+	} else if (sr1 & I2C_SR1_ADDR) {
+		uint16_t len = t->reading ? t->rx_len : t->tx_len;
+
+		if (len > 2) {
+			i2c_async_start_dma(i2c, t);
+		} else if (!t->reading || len == 1) {
+			I2C_CR2(i2c) |= I2C_CR2_ITBUFEN;
+		}
+
+		/* Reading SR2 after SR1 clears ADDR. */
+		(void)I2C_SR2(i2c);
+
+		if (!t->reading) {
+			if (len == 0) {
+				i2c_async_write_done(i2c, t);
+			}
+		} else if (len == 1) {
+			I2C_CR1(i2c) |= I2C_CR1_STOP;
+		} else if (len == 2) {
+			I2C_CR1(i2c) &= ~I2C_CR1_ACK;
+		}
+	} else if (!t->reading) {
+		if ((sr1 & I2C_SR1_TxE) && t->tx_count < t->tx_len) {
+			I2C_DR(i2c) = t->tx[t->tx_count++];
+			if (t->tx_count == t->tx_len) {
+				I2C_CR2(i2c) &= ~I2C_CR2_ITBUFEN;
+			}
+		} else if (sr1 & I2C_SR1_BTF) {
+			i2c_async_write_done(i2c, t);
+		}
+	} else if (t->rx_len == 1 && (sr1 & I2C_SR1_RxNE)) {
+		t->rx[0] = I2C_DR(i2c);
+		i2c_async_finish(i2c, t, I2C_TRANSFER_DONE);
+	} else if (t->rx_len == 2 && (sr1 & I2C_SR1_BTF)) {
+		I2C_CR1(i2c) |= I2C_CR1_STOP;
+		t->rx[0] = I2C_DR(i2c);
+		t->rx[1] = I2C_DR(i2c);
+		i2c_async_finish(i2c, t, I2C_TRANSFER_DONE);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief I2C Error Interrupt Handler
+
+To be called from the i2cN_er interrupt. Aborts the current transfer.
+
+@param[in] i2c I2C peripheral identifier @ref i2c_reg_base
+*/
+
+void i2c_er_isr(uint32_t i2c)
+{
+	struct i2c_async *t = i2c_async_get(i2c);
+	uint32_t sr1 = I2C_SR1(i2c);
+	enum i2c_transfer_status status;
+
+	I2C_SR1(i2c) &= ~(sr1 & I2C_SR1_ERRORS);
+	if (!t->busy) {
+		return;
+	}
+
+	if (sr1 & I2C_SR1_ARLO) {
+		/* The interface has already dropped back to slave mode. */
+		status = I2C_TRANSFER_ARBITRATION_LOST;
+	} else {
+		status = (sr1 & I2C_SR1_AF) ? I2C_TRANSFER_NACK :
+					      I2C_TRANSFER_BUS_ERROR;
+		I2C_CR1(i2c) |= I2C_CR1_STOP;
+	}
+
+	i2c_async_stop_dma(i2c);
+	i2c_async_finish(i2c, t, status);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief I2C DMA Interrupt Handler
+
+To be called from the interrupt of the I2C's RX DMA channel.
+
+@param[in] i2c I2C peripheral identifier @ref i2c_reg_base
+*/
+
+void i2c_dma_isr(uint32_t i2c)
+{
+	struct i2c_async *t = i2c_async_get(i2c);
+
+	if (!dma_get_interrupt_flag(DMA1, i2c_dma_rx_channel(i2c), DMA_TCIF)) {
+		return;
+	}
+
+	/* The last byte was NACKed, only the STOP is left. */
+	I2C_CR1(i2c) |= I2C_CR1_STOP;
+	i2c_async_stop_dma(i2c);
+	if (t->busy) {
+		i2c_async_finish(i2c, t, I2C_TRANSFER_DONE);
+	}
+}
+
+/**@}*/
@@ -16,13 +16,12 @@ Federico Ruiz-Ugalde \<memeruiz at gmail dot com\>
 This library supports the Reset and Clock Control System in the GD32F1x0
 series of ARM Cortex Microcontrollers by GigaDevice.
 
-@note Full support for F170 and F190 devices is not yet provided.
-
 Clock settings and resets for many peripherals are given here rather than in
 the corresponding peripheral library.
 
 The library also provides a number of common configurations for the processor
-system clock. Not all possible configurations are included.
+system clock. Other configurations, including the 108MHz of the F170 and F190
+devices, can be computed at runtime with @ref rcc_clock_compute_pll.
 
 LGPL License Terms @ref lgpl_license
  */
@@ -59,6 +58,8 @@ uint32_t rcc_apb1_frequency = 8000000;
 uint32_t rcc_apb2_frequency = 8000000;
 uint32_t rcc_ahb_frequency = 8000000;
 
+static void (*rcc_clock_change_callbacks[RCC_CLOCK_CHANGE_CALLBACKS])(void);
+
 const struct rcc_clock_scale rcc_hsi_configs[] = {
 	{ /* 48MHz */
 		.pllmul = RCC_CFGR_PLLMUL_PLL_CLK_MUL12,
@@ -67,6 +68,7 @@ const struct rcc_clock_scale rcc_hsi_configs[] = {
 		.ppre2 = RCC_CFGR_PPRE_NODIV,
 		.adcpre = RCC_CFGR_ADCPRE_DIV8,
 		.use_hse = false,
+		.flash_waitstates = FLASH_ACR_LATENCY_1WS,
 		.ahb_frequency	= 48000000,
 		.apb1_frequency = 24000000,
 		.apb2_frequency = 48000000,
@@ -78,6 +80,7 @@ const struct rcc_clock_scale rcc_hsi_configs[] = {
 		.ppre2 = RCC_CFGR_PPRE_NODIV,
 		.adcpre = RCC_CFGR_ADCPRE_DIV8,
 		.use_hse = false,
+		.flash_waitstates = FLASH_ACR_LATENCY_2WS,
 		.ahb_frequency	= 64000000,
 		.apb1_frequency = 32000000,
 		.apb2_frequency = 64000000,
@@ -94,6 +97,7 @@ const struct rcc_clock_scale rcc_hse8_configs[] = {
 		.usbpre = RCC_CFGR_USBPRE_PLL_CLK_DIV1_5,
 		.use_hse = true,
 		.pll_hse_prediv = RCC_CFGR2_PREDIV_NODIV,
+		.flash_waitstates = FLASH_ACR_LATENCY_2WS,
 		.ahb_frequency	= 72000000,
 		.apb1_frequency = 36000000,
 		.apb2_frequency = 72000000,
@@ -543,7 +547,8 @@ The prescale factor can be set to 1 (no prescale) for use when the PLL clock is
 
 void rcc_set_usbpre(uint32_t usbpre)
 {
-	RCC_CFGR = (RCC_CFGR & ~RCC_CFGR_USBPRE) | usbpre;
+	RCC_CFGR = (RCC_CFGR & ~RCC_CFGR_USBPRE) |
+			(usbpre << RCC_CFGR_USBPRE_SHIFT);
 }
 
 void rcc_set_prediv(uint32_t prediv)
@@ -592,6 +597,9 @@ void rcc_clock_setup_pll(const struct rcc_clock_scale *clock)
 		rcc_set_sysclk_source(RCC_CFGR_SW_SYSCLKSEL_HSICLK);
 	}
 
+	/* The PLL only takes new factors while it is disabled. */
+	rcc_osc_off(RCC_PLL);
+
 	/*
 	 * Set prescalers for AHB, ADC, APB1, APB2 and USB.
 	 * Do this before touching the PLL (TODO: why?).
@@ -625,6 +633,9 @@ void rcc_clock_setup_pll(const struct rcc_clock_scale *clock)
 	rcc_osc_on(RCC_PLL);
 	rcc_wait_for_osc_ready(RCC_PLL);
 
+	/* Flash must be slowed down before the fast clock is selected. */
+	flash_set_ws(clock->flash_waitstates);
+
 	/* Select PLL as SYSCLK source. */
 	rcc_set_sysclk_source(RCC_CFGR_SW_SYSCLKSEL_PLLCLK);
 
@@ -634,6 +645,216 @@ void rcc_clock_setup_pll(const struct rcc_clock_scale *clock)
 	rcc_apb2_frequency = clock->apb2_frequency;
 }
 
+/*---------------------------------------------------------------------------*/
+/** @brief RCC Register a Clock Change Callback
+
+The callback is run by @ref rcc_clock_switch once the new frequencies are in
+effect and rcc_ahb_frequency, rcc_apb1_frequency and rcc_apb2_frequency have
+been updated. It is meant to retune clock dependent peripherals, like USART
+baud rates or the SysTick reload value.
+
+@param[in] callback Function to call after each clock switch.
+@returns false if all @ref RCC_CLOCK_CHANGE_CALLBACKS slots are taken.
+*/
+
+bool rcc_clock_change_callback_register(void (*callback)(void))
+{
+	int i;
+
+	for (i = 0; i < RCC_CLOCK_CHANGE_CALLBACKS; i++) {
+		if (!rcc_clock_change_callbacks[i]) {
+			rcc_clock_change_callbacks[i] = callback;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief RCC Switch to another Clock Configuration
+
+Change the clock configuration at runtime with as few register accesses as
+possible. When the PLL already runs with the source, multiplier, HSE divider
+and USB prescaler of the target and drives the system clock, only the AHB, APB
+and ADC prescalers are rewritten, in a single RCC_CFGR write, and the PLL is
+left locked. The flash wait states are raised before and lowered after the
+change. Otherwise this falls back to @ref rcc_clock_setup_pll.
+
+Registered clock change callbacks are run afterwards.
+
+@param[in] clock clock information structure
+*/
+
+void rcc_clock_switch(const struct rcc_clock_scale *clock)
+{
+	const uint32_t prescalers = RCC_CFGR_HPRE | RCC_CFGR_PPRE1 |
+				    RCC_CFGR_PPRE2 | RCC_CFGR_ADCPRE;
+	uint32_t cfgr = RCC_CFGR;
+	uint32_t pllmul, reg32;
+	bool same_pll;
+	int i;
+
+	pllmul = ((cfgr & RCC_CFGR_PLLMUL_0_3) >> RCC_CFGR_PLLMUL_0_3_SHIFT) |
+		 ((cfgr & RCC_CFGR_PLLMUL_4) ? 0x10 : 0);
+
+	same_pll = rcc_system_clock_source() == RCC_CFGR_SWS_SYSCLKSEL_PLLCLK &&
+		   pllmul == clock->pllmul &&
+		   ((cfgr & RCC_CFGR_PLLSRC) != 0) == clock->use_hse;
+	if (same_pll && clock->use_hse) {
+		same_pll = (RCC_CFGR2 & RCC_CFGR2_PREDIV) ==
+			   clock->pll_hse_prediv &&
+			   ((cfgr & RCC_CFGR_USBPRE) >> RCC_CFGR_USBPRE_SHIFT) ==
+			   clock->usbpre;
+	}
+
+	if (!same_pll) {
+		rcc_clock_setup_pll(clock);
+	} else {
+		if (clock->ahb_frequency > rcc_ahb_frequency) {
+			flash_set_ws(clock->flash_waitstates);
+		}
+
+		reg32 = (cfgr & ~prescalers) |
+			(clock->hpre << RCC_CFGR_HPRE_SHIFT) |
+			(clock->ppre1 << RCC_CFGR_PPRE1_SHIFT) |
+			(clock->ppre2 << RCC_CFGR_PPRE2_SHIFT) |
+			(clock->adcpre << RCC_CFGR_ADCPRE_SHIFT);
+		if (reg32 != cfgr) {
+			RCC_CFGR = reg32;
+		}
+
+		if (clock->ahb_frequency <= rcc_ahb_frequency) {
+			flash_set_ws(clock->flash_waitstates);
+		}
+
+		rcc_ahb_frequency = clock->ahb_frequency;
+		rcc_apb1_frequency = clock->apb1_frequency;
+		rcc_apb2_frequency = clock->apb2_frequency;
+	}
+
+	for (i = 0; i < RCC_CLOCK_CHANGE_CALLBACKS; i++) {
+		if (rcc_clock_change_callbacks[i]) {
+			rcc_clock_change_callbacks[i]();
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief RCC Compute a PLL Configuration
+
+Search the PLL source divider and multiplier for the highest PLL output not
+above the requested system clock, then derive the bus, ADC and USB prescalers
+and the flash wait states. AHB runs at the system clock, APB1 and APB2 are
+divided down as little as possible to stay within @ref RCC_APB1_MAX_FREQUENCY
+and @ref RCC_APB2_MAX_FREQUENCY. The ADC clock is APB2/8, as in the fixed
+configurations, which keeps it at 9MHz or below.
+
+Only the pure computation is done here, the result is meant to be passed to
+@ref rcc_clock_setup_pll. This makes it usable on the host as well.
+
+@note The F130 and F150 devices are limited to 72MHz, the F170 and F190 to
+@ref RCC_PLL_MAX_FREQUENCY. Checking for the device specific limit is left to
+the caller.
+
+@param[in] sysclk Wanted system clock in Hz.
+@param[in] hse_frequency HSE frequency in Hz, or 0 to run from HSI/2.
+@param[in] usb Only accept PLL outputs that give the 48MHz USB clock. This
+requires the HSE, as the HSI is not accurate enough for USB.
+@param[out] clock Computed configuration.
+@returns true if a configuration was found.
+*/
+
+bool rcc_clock_compute_pll(uint32_t sysclk, uint32_t hse_frequency, bool usb,
+			   struct rcc_clock_scale *clock)
+{
+	/* USB prescalers, indexed by PLL output / 24MHz */
+	static const int8_t usbpre[] = {
+		[2] = RCC_CFGR_USBPRE_PLL_CLK_NODIV,
+		[3] = RCC_CFGR_USBPRE_PLL_CLK_DIV1_5,
+		[4] = RCC_CFGR_USBPRE_PLL_CLK_DIV2,
+		[5] = RCC_CFGR_USBPRE_PLL_CLK_DIV2_5,
+	};
+	static const uint8_t ppre[] = {
+		RCC_CFGR_PPRE_NODIV, RCC_CFGR_PPRE_DIV2, RCC_CFGR_PPRE_DIV4,
+		RCC_CFGR_PPRE_DIV8, RCC_CFGR_PPRE_DIV16,
+	};
+	uint32_t best = 0, best_prediv = 1, best_mul = 2;
+	uint32_t prediv, mul, pll_in, pll_out, div;
+	uint32_t max_prediv = hse_frequency ? 16 : 1;
+	int i;
+
+	if (usb && !hse_frequency) {
+		return false;
+	}
+
+	for (prediv = 1; prediv <= max_prediv; prediv++) {
+		if (hse_frequency) {
+			if (hse_frequency % prediv) {
+				continue;
+			}
+			pll_in = hse_frequency / prediv;
+		} else {
+			pll_in = 4000000;
+		}
+
+		for (mul = 2; mul <= 32; mul++) {
+			pll_out = pll_in * mul;
+			if (pll_out > sysclk || pll_out > RCC_PLL_MAX_FREQUENCY) {
+				break;
+			}
+			if (usb && (pll_out % 24000000 || pll_out < 48000000 ||
+				    pll_out > 120000000)) {
+				continue;
+			}
+			if (pll_out > best) {
+				best = pll_out;
+				best_prediv = prediv;
+				best_mul = mul;
+			}
+		}
+	}
+
+	if (!best) {
+		return false;
+	}
+
+	clock->use_hse = hse_frequency != 0;
+	clock->pll_hse_prediv = best_prediv - 1;
+	/* Multiplier 16 has two encodings, the upper range skips one. */
+	clock->pllmul = (best_mul <= 16) ? best_mul - 2 : best_mul - 1;
+	clock->usbpre = usb ? usbpre[best / 24000000] :
+			RCC_CFGR_USBPRE_PLL_CLK_DIV1_5;
+
+	clock->hpre = RCC_CFGR_HPRE_NODIV;
+	clock->ahb_frequency = best;
+
+	for (i = 0, div = 1; best / div > RCC_APB1_MAX_FREQUENCY; i++) {
+		div <<= 1;
+	}
+	clock->ppre1 = ppre[i];
+	clock->apb1_frequency = best / div;
+
+	for (i = 0, div = 1; best / div > RCC_APB2_MAX_FREQUENCY; i++) {
+		div <<= 1;
+	}
+	clock->ppre2 = ppre[i];
+	clock->apb2_frequency = best / div;
+
+	clock->adcpre = RCC_CFGR_ADCPRE_DIV8;
+
+	if (best <= 24000000) {
+		clock->flash_waitstates = FLASH_ACR_LATENCY_0WS;
+	} else if (best <= 48000000) {
+		clock->flash_waitstates = FLASH_ACR_LATENCY_1WS;
+	} else if (best <= 72000000) {
+		clock->flash_waitstates = FLASH_ACR_LATENCY_2WS;
+	} else {
+		clock->flash_waitstates = FLASH_ACR_LATENCY_3WS;
+	}
+
+	return true;
+}
+
 /*---------------------------------------------------------------------------*/
 /** @brief RCC Reset the Backup Domain
 
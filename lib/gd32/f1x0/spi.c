@@ -0,0 +1,134 @@
+/** @addtogroup spi_file
+
+@brief <b>libopencm3 GD32F1x0 SPI DMA transfers</b>
+
+Full duplex block transfers moved by DMA1 on the fixed SPI request channels,
+instead of one @ref spi_xfer call and two busy waits per frame.
+
+A transfer is started with @ref spi_transfer_dma and returns immediately. The
+interrupt of the RX DMA channel (dma_channel2_3 for SPI1, dma_channel4_5 for
+SPI2) has to be enabled in the NVIC and forwarded to @ref spi_dma_isr, which
+finishes the transfer and runs the completion callback. The frame size is
+taken from the current DFF setting.
+
+LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <libopencm3/gd32/dma.h>
+#include <libopencm3/gd32/spi.h>
+
+static void (*spi_dma_callback[2])(uint32_t spi);
+static uint16_t spi_dma_rx_dummy;
+static const uint16_t spi_dma_tx_dummy = 0xffff;
+
+static int spi_dma_index(uint32_t spi)
+{
+	return (spi == SPI1) ? 0 : 1;
+}
+
+static uint8_t spi_dma_rx_channel(uint32_t spi)
+{
+	return (spi == SPI1) ? SPI1_DMA_RX_CHANNEL : SPI2_DMA_RX_CHANNEL;
+}
+
+static uint8_t spi_dma_tx_channel(uint32_t spi)
+{
+	return (spi == SPI1) ? SPI1_DMA_TX_CHANNEL : SPI2_DMA_TX_CHANNEL;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief SPI Start a DMA Transfer
+
+The SPI has to be configured and enabled as master.
+
+@param[in] spi SPI peripheral identifier @ref spi_reg_base
+@param[in] tx Frames to send, or NULL to send all ones.
+@param[out] rx Buffer for the received frames, or NULL to discard them.
+@param[in] len Number of frames to transfer. With 0 nothing is transferred
+and the callback is called right away.
+@param[in] callback Called from @ref spi_dma_isr when done, may be NULL.
+*/
+
+void spi_transfer_dma(uint32_t spi, const void *tx, void *rx, uint16_t len,
+		      void (*callback)(uint32_t spi))
+{
+	uint32_t size = (SPI_CR1(spi) & SPI_CR1_DFF) ?
+			DMA_CCR_MSIZE_16BIT | DMA_CCR_PSIZE_16BIT :
+			DMA_CCR_MSIZE_8BIT | DMA_CCR_PSIZE_8BIT;
+	struct dma_transfer xfer;
+
+	if (!len) {
+		/* A DMA count of 0 never completes. */
+		if (callback) {
+			callback(spi);
+		}
+		return;
+	}
+
+	spi_dma_callback[spi_dma_index(spi)] = callback;
+
+	xfer.peripheral_address = (uint32_t)&SPI_DR(spi);
+	xfer.number = len;
+
+	/* RX first, so no frame can be missed once TX starts. */
+	xfer.memory_address = rx ? (uint32_t)rx : (uint32_t)&spi_dma_rx_dummy;
+	xfer.ccr = size | DMA_CCR_TCIE | DMA_CCR_PL_VERY_HIGH |
+		   (rx ? DMA_CCR_MINC : 0);
+	dma_start_transfer(DMA1, spi_dma_rx_channel(spi), &xfer);
+
+	xfer.memory_address = tx ? (uint32_t)tx : (uint32_t)&spi_dma_tx_dummy;
+	xfer.ccr = size | DMA_CCR_DIR | DMA_CCR_PL_HIGH |
+		   (tx ? DMA_CCR_MINC : 0);
+	dma_start_transfer(DMA1, spi_dma_tx_channel(spi), &xfer);
+
+	SPI_CR2(spi) |= SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief SPI DMA Interrupt Handler
+
+To be called from the interrupt of the SPI's RX DMA channel.
+
+@param[in] spi SPI peripheral identifier @ref spi_reg_base
+*/
+
+void spi_dma_isr(uint32_t spi)
+{
+	uint8_t rx_channel = spi_dma_rx_channel(spi);
+	void (*callback)(uint32_t spi);
+
+	if (!dma_get_interrupt_flag(DMA1, rx_channel, DMA_TCIF)) {
+		return;
+	}
+
+	SPI_CR2(spi) &= ~(SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+	DMA_CCR(DMA1, rx_channel) = 0;
+	DMA_CCR(DMA1, spi_dma_tx_channel(spi)) = 0;
+	DMA_IFCR(DMA1) = DMA_IFCR_CIF(rx_channel) |
+			 DMA_IFCR_CIF(spi_dma_tx_channel(spi));
+
+	callback = spi_dma_callback[spi_dma_index(spi)];
+	if (callback) {
+		callback(spi);
+	}
+}
+
+/**@}*/
@@ -0,0 +1,140 @@
+/** @addtogroup timer_file
+
+@brief <b>libopencm3 GD32F1x0 Timers</b>
+
+Besides the common timer API, this provides DMA burst updates: on every update
+event the timer requests a burst of DMA transfers through TIMx_DMAR, which
+writes a row of a waveform table into consecutive timer registers, typically
+the compare registers. A multi-channel PWM waveform can so be played back, or
+looped in circular mode, without an interrupt per period.
+
+The burst uses the DMA1 channel of the timer's update request. TIM6 and TIM14
+have no DMA burst support.
+
+LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <libopencm3/gd32/dma.h>
+#include <libopencm3/gd32/timer.h>
+
+static uint8_t timer_dma_up_channel(uint32_t timer)
+{
+	switch (timer) {
+	case TIM1:
+		return TIM1_DMA_UP_CHANNEL;
+	case TIM2:
+		return TIM2_DMA_UP_CHANNEL;
+	case TIM3:
+		return TIM3_DMA_UP_CHANNEL;
+	case TIM15:
+		return TIM15_DMA_UP_CHANNEL;
+	case TIM16:
+		return TIM16_DMA_UP_CHANNEL;
+	case TIM17:
+		return TIM17_DMA_UP_CHANNEL;
+	default:
+		return 0;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set Input Polarity
+
+@param[in] timer_peripheral Unsigned int32. Timer register address base
+@param[in] ic ::tim_ic_id. Input Capture channel designator.
+@param[in] pol ::tim_ic_pol. Input Capture polarity.
+*/
+
+void timer_ic_set_polarity(uint32_t timer_peripheral, enum tim_ic_id ic,
+			   enum tim_ic_pol pol)
+{
+	if (pol) {
+		TIM_CCER(timer_peripheral) |= (0x2 << (ic * 4));
+	} else {
+		TIM_CCER(timer_peripheral) &= ~(0x2 << (ic * 4));
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Timer Start DMA Burst Updates
+
+Each update event writes the next @p length entries of @p table to the timer
+registers starting at @p base. The entries are zero extended, so the compare
+registers of TIM2 can only be given 16 bit values. The timer itself has to be
+set up and enabled by the caller.
+
+@param[in] timer_peripheral Unsigned int32. Timer register address base
+@param[in] base Unsigned int8. First register written, from @ref tim_dcr_dba.
+@param[in] length Unsigned int8. Registers written per update, 1..18.
+@param[in] table Waveform table of @p updates rows of @p length entries.
+@param[in] updates Unsigned int16. Number of rows in @p table.
+@param[in] circular Restart from the first row after the last one.
+@returns false if the timer has no DMA burst support, or the table does not
+fit the DMA count of 65535 entries.
+*/
+
+bool timer_dma_burst_start(uint32_t timer_peripheral, uint8_t base,
+			   uint8_t length, const uint16_t *table,
+			   uint16_t updates, bool circular)
+{
+	uint8_t channel = timer_dma_up_channel(timer_peripheral);
+	struct dma_transfer xfer;
+
+	if (!channel || !length || !updates ||
+	    (uint32_t)updates * length > 0xffff) {
+		return false;
+	}
+
+	TIM_DCR(timer_peripheral) = ((length - 1) << TIM_DCR_DBL_SHIFT) |
+				    (base << TIM_DCR_DBA_SHIFT);
+
+	xfer.peripheral_address = (uint32_t)&TIM_DMAR(timer_peripheral);
+	xfer.memory_address = (uint32_t)table;
+	xfer.number = updates * length;
+	xfer.ccr = DMA_CCR_MSIZE_16BIT | DMA_CCR_PSIZE_32BIT | DMA_CCR_MINC |
+		   DMA_CCR_DIR | DMA_CCR_PL_HIGH |
+		   (circular ? DMA_CCR_CIRC : 0);
+	dma_start_transfer(DMA1, channel, &xfer);
+
+	TIM_DIER(timer_peripheral) |= TIM_DIER_UDE;
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Timer Stop DMA Burst Updates
+
+The compare registers keep the values of the last row written.
+
+@param[in] timer_peripheral Unsigned int32. Timer register address base
+*/
+
+void timer_dma_burst_stop(uint32_t timer_peripheral)
+{
+	uint8_t channel = timer_dma_up_channel(timer_peripheral);
+
+	TIM_DIER(timer_peripheral) &= ~TIM_DIER_UDE;
+	if (channel) {
+		DMA_CCR(DMA1, channel) = 0;
+		DMA_IFCR(DMA1) = DMA_IFCR_CIF(channel);
+	}
+}
+
+/**@}*/
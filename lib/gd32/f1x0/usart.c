@@ -0,0 +1,248 @@
+/** @addtogroup usart_file
+
+@brief <b>libopencm3 GD32F1x0 USART DMA streams</b>
+
+A USART stream moves data between the USART and a pair of user supplied ring
+buffers with DMA, so the CPU is only involved once per burst instead of once
+per byte.
+
+RX runs as a circular DMA transfer into rx_buf, the write position being
+derived from the channel's remaining transfer count. The idle line interrupt
+signals the end of a burst through the rx_idle callback. The ring is not
+protected against overrun, so rx_buf has to hold everything that can arrive
+between two calls to @ref usart_stream_read.
+
+TX copies into tx_buf and drains it with one-shot DMA transfers of the largest
+contiguous chunk available, restarted from the TX channel's transfer complete
+interrupt.
+
+The user has to enable the clocks of the USART and DMA, configure the USART
+and pins, and forward the USART and TX DMA channel interrupts to
+@ref usart_stream_usart_isr and @ref usart_stream_tx_dma_isr.
+
+LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <string.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/gd32/dma.h>
+#include <libopencm3/gd32/usart.h>
+
+static void usart_stream_tx_kick(struct usart_stream *stream)
+{
+	uint16_t head = stream->tx_head;
+	uint16_t tail = stream->tx_tail;
+	struct dma_transfer xfer;
+
+	if (stream->tx_pending || head == tail) {
+		return;
+	}
+
+	xfer.peripheral_address = (uint32_t)&USART_TDR(stream->usart);
+	xfer.memory_address = (uint32_t)&stream->tx_buf[tail];
+	xfer.number = (head > tail) ? head - tail : stream->tx_size - tail;
+	xfer.ccr = DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_TCIE |
+		   DMA_CCR_PL_HIGH;
+
+	stream->tx_pending = xfer.number;
+	dma_start_transfer(stream->dma, stream->tx_channel, &xfer);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief USART Stream Initialize
+
+Starts the circular RX transfer, enables the idle line interrupt and the
+USART DMA requests. The USART itself should be enabled afterwards.
+
+@param[in] stream Stream with the user fields filled in.
+*/
+
+void usart_stream_init(struct usart_stream *stream)
+{
+	struct dma_transfer xfer = {
+		.peripheral_address = (uint32_t)&USART_RDR(stream->usart),
+		.memory_address = (uint32_t)stream->rx_buf,
+		.number = stream->rx_size,
+		.ccr = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_PL_VERY_HIGH,
+	};
+
+	stream->rx_tail = 0;
+	stream->tx_head = 0;
+	stream->tx_tail = 0;
+	stream->tx_pending = 0;
+
+	dma_start_transfer(stream->dma, stream->rx_channel, &xfer);
+
+	USART_ICR(stream->usart) = USART_ICR_IDLECF;
+	usart_enable_idle_interrupt(stream->usart);
+	usart_enable_rx_dma(stream->usart);
+	usart_enable_tx_dma(stream->usart);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief USART Stream Number of Received Bytes
+
+@param[in] stream Initialized stream.
+@returns Number of bytes waiting in the RX ring.
+*/
+
+uint16_t usart_stream_rx_available(struct usart_stream *stream)
+{
+	uint16_t head = stream->rx_size -
+			DMA_CNDTR(stream->dma, stream->rx_channel);
+
+	if (head == stream->rx_size) {
+		head = 0;
+	}
+	if (head >= stream->rx_tail) {
+		return head - stream->rx_tail;
+	}
+	return stream->rx_size - stream->rx_tail + head;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief USART Stream Read
+
+@param[in] stream Initialized stream.
+@param[out] data Destination buffer.
+@param[in] len Size of the destination buffer.
+@returns Number of bytes copied, at most len.
+*/
+
+uint16_t usart_stream_read(struct usart_stream *stream, uint8_t *data,
+			   uint16_t len)
+{
+	uint16_t avail = usart_stream_rx_available(stream);
+	uint16_t chunk;
+
+	if (len > avail) {
+		len = avail;
+	}
+
+	/* At most two copies, before and after the wrap. */
+	chunk = stream->rx_size - stream->rx_tail;
+	if (chunk > len) {
+		chunk = len;
+	}
+	memcpy(data, &stream->rx_buf[stream->rx_tail], chunk);
+	memcpy(&data[chunk], stream->rx_buf, len - chunk);
+
+	stream->rx_tail += len;
+	if (stream->rx_tail >= stream->rx_size) {
+		stream->rx_tail -= stream->rx_size;
+	}
+	return len;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief USART Stream Write
+
+Queue data for transmission and start the TX DMA if it is idle. One byte of
+tx_buf is kept free to tell a full ring from an empty one.
+
+@param[in] stream Initialized stream.
+@param[in] data Data to send.
+@param[in] len Number of bytes to send.
+@returns Number of bytes queued, less than len if the ring is full.
+*/
+
+uint16_t usart_stream_write(struct usart_stream *stream, const uint8_t *data,
+			    uint16_t len)
+{
+	uint16_t head = stream->tx_head;
+	uint16_t tail = stream->tx_tail;
+	uint16_t space, chunk;
+
+	space = (tail > head) ? tail - head - 1 :
+		stream->tx_size - head + tail - 1;
+	if (len > space) {
+		len = space;
+	}
+
+	chunk = stream->tx_size - head;
+	if (chunk > len) {
+		chunk = len;
+	}
+	memcpy(&stream->tx_buf[head], data, chunk);
+	memcpy(stream->tx_buf, &data[chunk], len - chunk);
+
+	head += len;
+	if (head >= stream->tx_size) {
+		head -= stream->tx_size;
+	}
+
+	CM_ATOMIC_BLOCK() {
+		stream->tx_head = head;
+		usart_stream_tx_kick(stream);
+	}
+	return len;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief USART Stream USART Interrupt Handler
+
+To be called from the USART interrupt. Clears the idle line flag and runs the
+rx_idle callback.
+
+@param[in] stream Initialized stream.
+*/
+
+void usart_stream_usart_isr(struct usart_stream *stream)
+{
+	if (USART_ISR(stream->usart) & USART_ISR_IDLE) {
+		USART_ICR(stream->usart) = USART_ICR_IDLECF;
+		if (stream->rx_idle) {
+			stream->rx_idle(stream);
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief USART Stream TX DMA Interrupt Handler
+
+To be called from the interrupt of the TX DMA channel. Releases the chunk that
+was sent and starts the next one.
+
+@param[in] stream Initialized stream.
+*/
+
+void usart_stream_tx_dma_isr(struct usart_stream *stream)
+{
+	uint16_t tail;
+
+	if (!dma_get_interrupt_flag(stream->dma, stream->tx_channel,
+				    DMA_TCIF)) {
+		return;
+	}
+	dma_clear_interrupt_flags(stream->dma, stream->tx_channel, DMA_TCIF);
+
+	tail = stream->tx_tail + stream->tx_pending;
+	if (tail >= stream->tx_size) {
+		tail -= stream->tx_size;
+	}
+	stream->tx_tail = tail;
+	stream->tx_pending = 0;
+
+	usart_stream_tx_kick(stream);
+}
+
+/**@}*/
@@ -19,6 +19,7 @@
  */
 
 #include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/cortex.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/tools.h>
 #include <libopencm3/stm32/st_usbfs.h>
@@ -28,8 +29,14 @@
 
 /* TODO - can't these be inside the impls, not globals from the core? */
 uint8_t st_usbfs_force_nak[8];
+bool st_usbfs_sof_enabled;
 struct _usbd_device st_usbfs_dev;
 
+/* Endpoints set up with USBD_EP_DOUBLE_BUFFER, one bit per endpoint. */
+static uint8_t st_usbfs_double_buffer;
+/* Double buffered bulk IN endpoints with a packet waiting for hand over. */
+static uint8_t st_usbfs_db_staged;
+
 void st_usbfs_set_address(usbd_device *dev, uint8_t addr)
 {
 	(void)dev;
@@ -77,7 +84,122 @@ uint16_t st_usbfs_set_ep_rx_bufsize(usbd_device *dev, uint8_t ep, uint32_t size)
 	return realsize;
 }
 
-void st_usbfs_ep_setup(usbd_device *dev, uint8_t addr, uint8_t type,
+/*
+ * Packet memory held by each endpoint: slot 0 is the TX buffer (buffer 0
+ * when double buffered), slot 1 the RX buffer (buffer 1). A zero size marks
+ * a free slot. The BTABLE itself occupies the first USBD_PM_TOP bytes.
+ */
+static struct {
+	uint16_t addr;
+	uint16_t size;
+} st_usbfs_pm[8 * 2];
+
+static void st_usbfs_pm_free(uint8_t ep, uint8_t slot)
+{
+	st_usbfs_pm[(ep << 1) | slot].size = 0;
+}
+
+/*
+ * Place a buffer in the lowest hole of packet memory that fits it.
+ * Returns the buffer address or 0 if packet memory is exhausted.
+ */
+static uint16_t st_usbfs_pm_alloc(uint8_t ep, uint8_t slot, uint16_t size)
+{
+	uint16_t addr = USBD_PM_TOP;
+	int i;
+
+	size = (size + USBD_PM_ALIGN - 1) & ~(USBD_PM_ALIGN - 1);
+
+	/* Move past every buffer overlapping the candidate, then rescan. */
+	for (i = 0; i < 8 * 2; i++) {
+		if (st_usbfs_pm[i].size &&
+		    addr < st_usbfs_pm[i].addr + st_usbfs_pm[i].size &&
+		    st_usbfs_pm[i].addr < addr + size) {
+			addr = st_usbfs_pm[i].addr + st_usbfs_pm[i].size;
+			i = -1;
+		}
+	}
+
+	if (addr + size > USB_PMA_SIZE) {
+		return 0;
+	}
+
+	st_usbfs_pm[(ep << 1) | slot].addr = addr;
+	st_usbfs_pm[(ep << 1) | slot].size = size;
+	return addr;
+}
+
+/*
+ * Both packet buffers of a double buffered endpoint serve the one direction
+ * it is set up for: buffer 0 lives in the TX descriptor, buffer 1 in the RX
+ * descriptor. For bulk endpoints SW_BUF marks the buffer owned by the
+ * application and the peripheral NAKs once it needs that buffer. For
+ * isochronous endpoints there is no handshake, DTOG alone picks the buffer
+ * used by the peripheral in the current frame.
+ */
+static int st_usbfs_ep_setup_double(usbd_device *dev, uint8_t addr,
+		uint8_t type, uint16_t max_size,
+		void (*callback) (usbd_device *usbd_dev,
+		uint8_t ep))
+{
+	uint8_t dir = addr & 0x80;
+	uint16_t size = max_size;
+	uint16_t buf0, buf1;
+	addr &= 0x7f;
+
+	st_usbfs_pm_free(addr, 0);
+	st_usbfs_pm_free(addr, 1);
+	if (!dir) {
+		size = st_usbfs_set_ep_rx_bufsize(dev, addr, max_size);
+		USB_SET_EP_TX_COUNT(addr, USB_GET_EP_RX_COUNT(addr));
+	}
+	buf0 = st_usbfs_pm_alloc(addr, 0, size);
+	buf1 = buf0 ? st_usbfs_pm_alloc(addr, 1, size) : 0;
+	if (!buf1) {
+		st_usbfs_pm_free(addr, 0);
+		USB_SET_EP_TX_STAT(addr, USB_EP_TX_STAT_DISABLED);
+		USB_SET_EP_RX_STAT(addr, USB_EP_RX_STAT_DISABLED);
+		return -1;
+	}
+
+	if (type == USB_ENDPOINT_ATTR_BULK) {
+		USB_SET_EP_KIND(addr);
+	}
+	st_usbfs_double_buffer |= 1 << addr;
+	st_usbfs_db_staged &= ~(1 << addr);
+	USB_SET_EP_TX_ADDR(addr, buf0);
+	USB_SET_EP_RX_ADDR(addr, buf1);
+	USB_CLR_EP_TX_DTOG(addr);
+	USB_CLR_EP_RX_DTOG(addr);
+
+	if (dir) {
+		USB_SET_EP_TX_COUNT(addr, 0);
+		USB_SET_EP_RX_COUNT(addr, 0);
+		if (callback) {
+			dev->user_callback_ctr[addr][USB_TRANSACTION_IN] =
+			    (void *)callback;
+		}
+		USB_SET_EP_RX_STAT(addr, USB_EP_RX_STAT_DISABLED);
+		/* Isochronous endpoints send empty packets until written. */
+		USB_SET_EP_TX_STAT(addr, type == USB_ENDPOINT_ATTR_ISOCHRONOUS ?
+				   USB_EP_TX_STAT_VALID : USB_EP_TX_STAT_NAK);
+	} else {
+		if (callback) {
+			dev->user_callback_ctr[addr][USB_TRANSACTION_OUT] =
+			    (void *)callback;
+		}
+		/* The peripheral receives into buffer 0, we hold buffer 1. */
+		if (type == USB_ENDPOINT_ATTR_BULK) {
+			USB_TOG_EP_RX_SW_BUF(addr);
+		}
+		USB_SET_EP_TX_STAT(addr, USB_EP_TX_STAT_DISABLED);
+		USB_SET_EP_RX_STAT(addr, USB_EP_RX_STAT_VALID);
+	}
+
+	return 0;
+}
+
+int st_usbfs_ep_setup(usbd_device *dev, uint8_t addr, uint8_t type,
 		uint16_t max_size,
 		void (*callback) (usbd_device *usbd_dev,
 		uint8_t ep))
@@ -90,47 +212,81 @@ void st_usbfs_ep_setup(usbd_device *dev, uint8_t addr, uint8_t type,
 		[USB_ENDPOINT_ATTR_INTERRUPT] = USB_EP_TYPE_INTERRUPT,
 	};
 	uint8_t dir = addr & 0x80;
+	bool dbl = type & USBD_EP_DOUBLE_BUFFER;
 	addr &= 0x7f;
+	type &= USB_ENDPOINT_ATTR_TYPE;
 
 	/* Assign address. */
 	USB_SET_EP_ADDR(addr, addr);
 	USB_SET_EP_TYPE(addr, typelookup[type]);
 
+	if (addr != 0) {
+		if (dbl && (type == USB_ENDPOINT_ATTR_BULK ||
+			    type == USB_ENDPOINT_ATTR_ISOCHRONOUS)) {
+			return st_usbfs_ep_setup_double(dev, addr | dir, type,
+							max_size, callback);
+		}
+		USB_CLR_EP_KIND(addr);
+		if (st_usbfs_double_buffer & (1 << addr)) {
+			/* Both buffers served the old setup. */
+			st_usbfs_double_buffer &= ~(1 << addr);
+			st_usbfs_pm_free(addr, 0);
+			st_usbfs_pm_free(addr, 1);
+		}
+	}
+
 	if (dir || (addr == 0)) {
-		USB_SET_EP_TX_ADDR(addr, dev->pm_top);
+		uint16_t pm;
+		st_usbfs_pm_free(addr, 0);
+		pm = st_usbfs_pm_alloc(addr, 0, max_size);
+		if (!pm) {
+			USB_SET_EP_TX_STAT(addr, USB_EP_TX_STAT_DISABLED);
+			return -1;
+		}
+		USB_SET_EP_TX_ADDR(addr, pm);
 		if (callback) {
 			dev->user_callback_ctr[addr][USB_TRANSACTION_IN] =
 			    (void *)callback;
 		}
 		USB_CLR_EP_TX_DTOG(addr);
 		USB_SET_EP_TX_STAT(addr, USB_EP_TX_STAT_NAK);
-		dev->pm_top += max_size;
 	}
 
 	if (!dir) {
-		uint16_t realsize;
-		USB_SET_EP_RX_ADDR(addr, dev->pm_top);
+		uint16_t pm, realsize;
+		st_usbfs_pm_free(addr, 1);
 		realsize = st_usbfs_set_ep_rx_bufsize(dev, addr, max_size);
+		pm = st_usbfs_pm_alloc(addr, 1, realsize);
+		if (!pm) {
+			USB_SET_EP_RX_STAT(addr, USB_EP_RX_STAT_DISABLED);
+			return -1;
+		}
+		USB_SET_EP_RX_ADDR(addr, pm);
 		if (callback) {
 			dev->user_callback_ctr[addr][USB_TRANSACTION_OUT] =
 			    (void *)callback;
 		}
 		USB_CLR_EP_RX_DTOG(addr);
 		USB_SET_EP_RX_STAT(addr, USB_EP_RX_STAT_VALID);
-		dev->pm_top += realsize;
 	}
+
+	return 0;
 }
 
 void st_usbfs_endpoints_reset(usbd_device *dev)
 {
 	int i;
 
-	/* Reset all endpoints. */
+	(void)dev;
+	/* Reset all endpoints, only EP0 keeps its packet memory. */
 	for (i = 1; i < 8; i++) {
 		USB_SET_EP_TX_STAT(i, USB_EP_TX_STAT_DISABLED);
 		USB_SET_EP_RX_STAT(i, USB_EP_RX_STAT_DISABLED);
+		st_usbfs_pm_free(i, 0);
+		st_usbfs_pm_free(i, 1);
 	}
-	dev->pm_top = USBD_PM_TOP + (2 * dev->desc->bMaxPacketSize0);
+	st_usbfs_double_buffer = 0;
+	st_usbfs_db_staged = 0;
 }
 
 void st_usbfs_ep_stall_set(usbd_device *dev, uint8_t addr,
@@ -151,11 +307,19 @@ void st_usbfs_ep_stall_set(usbd_device *dev, uint8_t addr,
 		/* Reset to DATA0 if clearing stall condition. */
 		if (!stall) {
 			USB_CLR_EP_TX_DTOG(addr);
+			if (st_usbfs_double_buffer & (1 << addr)) {
+				USB_CLR_EP_RX_DTOG(addr);
+				st_usbfs_db_staged &= ~(1 << addr);
+			}
 		}
 	} else {
 		/* Reset to DATA0 if clearing stall condition. */
 		if (!stall) {
 			USB_CLR_EP_RX_DTOG(addr);
+			if (st_usbfs_double_buffer & (1 << addr)) {
+				USB_CLR_EP_TX_DTOG(addr);
+				USB_TOG_EP_RX_SW_BUF(addr);
+			}
 		}
 
 		USB_SET_EP_RX_STAT(addr, stall ? USB_EP_RX_STAT_STALL :
@@ -197,12 +361,67 @@ void st_usbfs_ep_nak_set(usbd_device *dev, uint8_t addr, uint8_t nak)
 	}
 }
 
+static uint16_t st_usbfs_ep_write_packet_double(uint8_t addr,
+		const void *buf, uint16_t len)
+{
+	uint16_t reg = *USB_EP_REG(addr);
+	uint32_t mask;
+	bool buf1;
+
+	if ((reg & USB_EP_TYPE) == USB_EP_TYPE_ISO) {
+		/* Fill the buffer the peripheral is not using this frame. */
+		buf1 = !(reg & USB_EP_TX_DTOG);
+	} else {
+		if (st_usbfs_db_staged & (1 << addr)) {
+			return 0;
+		}
+		buf1 = reg & USB_EP_TX_SW_BUF;
+	}
+
+	if (buf1) {
+		st_usbfs_copy_to_pm(USB_GET_EP_RX_BUFF(addr), buf, len);
+		USB_SET_EP_RX_COUNT(addr, len);
+	} else {
+		st_usbfs_copy_to_pm(USB_GET_EP_TX_BUFF(addr), buf, len);
+		USB_SET_EP_TX_COUNT(addr, len);
+	}
+
+	if ((reg & USB_EP_TYPE) == USB_EP_TYPE_ISO) {
+		return len;
+	}
+
+	/*
+	 * The transfer complete interrupt may hand the staged buffer over in
+	 * between, so look at the peripheral and stage with it masked.
+	 */
+	mask = cm_mask_interrupts(1);
+	reg = *USB_EP_REG(addr);
+	if ((reg & USB_EP_TX_STAT) != USB_EP_TX_STAT_VALID) {
+		/* First packet since setup or clearing a stall. */
+		USB_TOG_EP_TX_SW_BUF(addr);
+		USB_SET_EP_TX_STAT(addr, USB_EP_TX_STAT_VALID);
+	} else if (!(reg & USB_EP_TX_DTOG) == !(reg & USB_EP_TX_SW_BUF)) {
+		/* The peripheral is idle, waiting for our buffer. */
+		USB_TOG_EP_TX_SW_BUF(addr);
+	} else {
+		/* Still sending the other buffer, hand over on completion. */
+		st_usbfs_db_staged |= 1 << addr;
+	}
+	cm_mask_interrupts(mask);
+
+	return len;
+}
+
 uint16_t st_usbfs_ep_write_packet(usbd_device *dev, uint8_t addr,
 				     const void *buf, uint16_t len)
 {
 	(void)dev;
 	addr &= 0x7F;
 
+	if (st_usbfs_double_buffer & (1 << addr)) {
+		return st_usbfs_ep_write_packet_double(addr, buf, len);
+	}
+
 	if ((*USB_EP_REG(addr) & USB_EP_TX_STAT) == USB_EP_TX_STAT_VALID) {
 		return 0;
 	}
@@ -214,10 +433,54 @@ uint16_t st_usbfs_ep_write_packet(usbd_device *dev, uint8_t addr,
 	return len;
 }
 
+static uint16_t st_usbfs_ep_read_packet_double(uint8_t addr,
+		void *buf, uint16_t len)
+{
+	uint16_t reg = *USB_EP_REG(addr);
+	bool buf1;
+
+	if ((reg & USB_EP_TYPE) == USB_EP_TYPE_ISO) {
+		if (!(reg & USB_EP_RX_CTR)) {
+			return 0;
+		}
+		/* DTOG already points at the buffer for the next frame. */
+		buf1 = !(reg & USB_EP_RX_DTOG);
+	} else {
+		/* A packet is ready once the peripheral waits for our buffer. */
+		if (!(reg & USB_EP_RX_DTOG) != !(reg & USB_EP_RX_SW_BUF)) {
+			return 0;
+		}
+		buf1 = !(reg & USB_EP_RX_SW_BUF);
+	}
+
+	USB_CLR_EP_RX_CTR(addr);
+	if ((reg & USB_EP_TYPE) != USB_EP_TYPE_ISO) {
+		/*
+		 * Take the filled buffer, so the next packet can arrive while
+		 * this one is copied out.
+		 */
+		USB_TOG_EP_RX_SW_BUF(addr);
+	}
+
+	if (buf1) {
+		len = MIN(USB_GET_EP_RX_COUNT(addr) & 0x3ff, len);
+		st_usbfs_copy_from_pm(buf, USB_GET_EP_RX_BUFF(addr), len);
+	} else {
+		len = MIN(USB_GET_EP_TX_COUNT(addr) & 0x3ff, len);
+		st_usbfs_copy_from_pm(buf, USB_GET_EP_TX_BUFF(addr), len);
+	}
+
+	return len;
+}
+
 uint16_t st_usbfs_ep_read_packet(usbd_device *dev, uint8_t addr,
 					 void *buf, uint16_t len)
 {
 	(void)dev;
+	if (st_usbfs_double_buffer & (1 << addr)) {
+		return st_usbfs_ep_read_packet_double(addr, buf, len);
+	}
+
 	if ((*USB_EP_REG(addr) & USB_EP_RX_STAT) == USB_EP_RX_STAT_VALID) {
 		return 0;
 	}
@@ -233,21 +496,56 @@ uint16_t st_usbfs_ep_read_packet(usbd_device *dev, uint8_t addr,
 	return len;
 }
 
+/* Transaction complete on a double buffered IN endpoint. */
+static void st_usbfs_ep_tx_done_double(uint8_t ep)
+{
+	uint16_t reg = *USB_EP_REG(ep);
+
+	if ((reg & USB_EP_TYPE) == USB_EP_TYPE_ISO) {
+		/* Don't send the same packet again in a later frame. */
+		if (reg & USB_EP_TX_DTOG) {
+			USB_SET_EP_TX_COUNT(ep, 0);
+		} else {
+			USB_SET_EP_RX_COUNT(ep, 0);
+		}
+	} else if (st_usbfs_db_staged & (1 << ep)) {
+		st_usbfs_db_staged &= ~(1 << ep);
+		USB_TOG_EP_TX_SW_BUF(ep);
+	}
+}
+
 void st_usbfs_poll(usbd_device *dev)
 {
 	uint16_t istr = *USB_ISTR_REG;
+	uint16_t serviced = 0;
+	bool sof;
 
 	if (istr & USB_ISTR_RESET) {
 		USB_CLR_ISTR_RESET();
-		dev->pm_top = USBD_PM_TOP;
+		/* The bus reset disabled every endpoint, release their memory. */
+		st_usbfs_endpoints_reset(dev);
+		st_usbfs_pm_free(0, 0);
+		st_usbfs_pm_free(0, 1);
 		_usbd_reset(dev);
 		return;
 	}
 
-	if (istr & USB_ISTR_CTR) {
+	/*
+	 * Drain every endpoint with a completed transaction, so a burst of
+	 * packets costs one interrupt. Each endpoint direction is handled at
+	 * most once per call, in case its callback leaves the packet in the
+	 * buffer and CTR set.
+	 */
+	while (istr & USB_ISTR_CTR) {
 		uint8_t ep = istr & USB_ISTR_EP_ID;
+		uint16_t handled = 1 << ((ep << 1) | !!(istr & USB_ISTR_DIR));
 		uint8_t type;
 
+		if (serviced & handled) {
+			break;
+		}
+		serviced |= handled;
+
 		if (istr & USB_ISTR_DIR) {
 			/* OUT or SETUP? */
 			if (*USB_EP_REG(ep) & USB_EP_SETUP) {
@@ -259,6 +557,9 @@ void st_usbfs_poll(usbd_device *dev)
 		} else {
 			type = USB_TRANSACTION_IN;
 			USB_CLR_EP_TX_CTR(ep);
+			if (st_usbfs_double_buffer & (1 << ep)) {
+				st_usbfs_ep_tx_done_double(ep);
+			}
 		}
 
 		if (dev->user_callback_ctr[ep][type]) {
@@ -266,6 +567,8 @@ void st_usbfs_poll(usbd_device *dev)
 		} else {
 			USB_CLR_EP_RX_CTR(ep);
 		}
+
+		istr = *USB_ISTR_REG;
 	}
 
 	if (istr & USB_ISTR_SUSP) {
@@ -289,9 +592,14 @@ void st_usbfs_poll(usbd_device *dev)
 		}
 	}
 
-	if (dev->user_callback_sof) {
-		*USB_CNTR_REG |= USB_CNTR_SOFM;
-	} else {
-		*USB_CNTR_REG &= ~USB_CNTR_SOFM;
+	/* Only touch CNTR when the SOF callback has been (un)registered. */
+	sof = dev->user_callback_sof ? true : false;
+	if (sof != st_usbfs_sof_enabled) {
+		st_usbfs_sof_enabled = sof;
+		if (sof) {
+			*USB_CNTR_REG |= USB_CNTR_SOFM;
+		} else {
+			*USB_CNTR_REG &= ~USB_CNTR_SOFM;
+		}
 	}
 }
@@ -31,11 +31,13 @@
 #include <libopencm3/usb/usbd.h>
 
 #define USBD_PM_TOP 0x40
+/* Packet buffer addresses in the BTABLE must be halfword aligned. */
+#define USBD_PM_ALIGN 2
 
 void st_usbfs_set_address(usbd_device *dev, uint8_t addr);
 uint16_t st_usbfs_set_ep_rx_bufsize(usbd_device *dev, uint8_t ep, uint32_t size);
 
-void st_usbfs_ep_setup(usbd_device *usbd_dev, uint8_t addr,
+int st_usbfs_ep_setup(usbd_device *usbd_dev, uint8_t addr,
 		uint8_t type, uint16_t max_size,
 		void (*callback) (usbd_device *usbd_dev,
 		uint8_t ep));
@@ -71,6 +73,7 @@ void st_usbfs_copy_from_pm(void *buf, const volatile void *vPM, uint16_t len);
 void st_usbfs_copy_to_pm(volatile void *vPM, const void *buf, uint16_t len);
 
 extern uint8_t st_usbfs_force_nak[8];
+extern bool st_usbfs_sof_enabled;
 extern struct _usbd_device st_usbfs_dev;
 
 #endif
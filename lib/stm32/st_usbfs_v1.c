@@ -51,36 +51,112 @@ static usbd_device *st_usbfs_v1_usbd_init(void)
 	/* Enable RESET, SUSPEND, RESUME and CTR interrupts. */
 	SET_REG(USB_CNTR_REG, USB_CNTR_RESETM | USB_CNTR_CTRM |
 		USB_CNTR_SUSPM | USB_CNTR_WKUPM);
+	st_usbfs_sof_enabled = false;
 	return &st_usbfs_dev;
 }
 
+/*
+ * The copy kernels move a word per load or store on the user buffer when it
+ * is word aligned, and fall back to byte accesses otherwise, so any buffer
+ * works on cores without unaligned access support. Both paths are unrolled
+ * so a 64 byte packet takes four (aligned) or eight (unaligned) rounds.
+ * Halfword i of a packet sits in the low half of PMA word i, so the kernels
+ * step through packet memory two halfwords at a time.
+ */
 void st_usbfs_copy_to_pm(volatile void *vPM, const void *buf, uint16_t len)
 {
-	const uint16_t *lbuf = buf;
-	volatile uint32_t *PM = vPM;
-	for (len = (len + 1) >> 1; len; len--) {
-		*PM++ = *lbuf++;
+	volatile uint16_t *PM = vPM;
+	const uint8_t *lbuf;
+	uint8_t odd = len & 1;
+
+	len >>= 1;
+	if (((uintptr_t) buf & 0x03) == 0) {
+		const uint32_t *wbuf = buf;
+
+		for (; len >= 8; len -= 8, PM += 16, wbuf += 4) {
+			uint32_t w0 = wbuf[0];
+			uint32_t w1 = wbuf[1];
+			uint32_t w2 = wbuf[2];
+			uint32_t w3 = wbuf[3];
+
+			PM[0] = w0;
+			PM[2] = w0 >> 16;
+			PM[4] = w1;
+			PM[6] = w1 >> 16;
+			PM[8] = w2;
+			PM[10] = w2 >> 16;
+			PM[12] = w3;
+			PM[14] = w3 >> 16;
+		}
+		buf = wbuf;
+	}
+
+	lbuf = buf;
+	for (; len >= 4; len -= 4, PM += 8, lbuf += 8) {
+		PM[0] = lbuf[0] | lbuf[1] << 8;
+		PM[2] = lbuf[2] | lbuf[3] << 8;
+		PM[4] = lbuf[4] | lbuf[5] << 8;
+		PM[6] = lbuf[6] | lbuf[7] << 8;
+	}
+	for (; len; len--, PM += 2, lbuf += 2) {
+		*PM = lbuf[0] | lbuf[1] << 8;
+	}
+
+	if (odd) {
+		*PM = *lbuf;
 	}
 }
 
 /**
  * Copy a data buffer from packet memory.
  *
- * @param buf Source pointer to data buffer.
- * @param vPM Destination pointer into packet memory.
+ * @param buf Destination pointer for data buffer.
+ * @param vPM Source pointer into packet memory.
  * @param len Number of bytes to copy.
  */
 void st_usbfs_copy_from_pm(void *buf, const volatile void *vPM, uint16_t len)
 {
-	uint16_t *lbuf = buf;
 	const volatile uint16_t *PM = vPM;
+	uint8_t *lbuf;
 	uint8_t odd = len & 1;
 
-	for (len >>= 1; len; PM += 2, lbuf++, len--) {
-		*lbuf = *PM;
+	len >>= 1;
+	if (((uintptr_t) buf & 0x03) == 0) {
+		uint32_t *wbuf = buf;
+
+		for (; len >= 8; len -= 8, PM += 16, wbuf += 4) {
+			wbuf[0] = PM[0] | (uint32_t)PM[2] << 16;
+			wbuf[1] = PM[4] | (uint32_t)PM[6] << 16;
+			wbuf[2] = PM[8] | (uint32_t)PM[10] << 16;
+			wbuf[3] = PM[12] | (uint32_t)PM[14] << 16;
+		}
+		buf = wbuf;
+	}
+
+	lbuf = buf;
+	for (; len >= 4; len -= 4, PM += 8, lbuf += 8) {
+		uint16_t h0 = PM[0];
+		uint16_t h1 = PM[2];
+		uint16_t h2 = PM[4];
+		uint16_t h3 = PM[6];
+
+		lbuf[0] = h0;
+		lbuf[1] = h0 >> 8;
+		lbuf[2] = h1;
+		lbuf[3] = h1 >> 8;
+		lbuf[4] = h2;
+		lbuf[5] = h2 >> 8;
+		lbuf[6] = h3;
+		lbuf[7] = h3 >> 8;
+	}
+	for (; len; len--, PM += 2, lbuf += 2) {
+		uint16_t value = *PM;
+
+		lbuf[0] = value;
+		lbuf[1] = value >> 8;
 	}
 
 	if (odd) {
-		*(uint8_t *) lbuf = *(uint8_t *) PM;
+		*lbuf = *PM;
 	}
 }
@@ -37,21 +37,60 @@ static usbd_device *st_usbfs_v2_usbd_init(void)
 	/* Enable RESET, SUSPEND, RESUME and CTR interrupts. */
 	SET_REG(USB_CNTR_REG, USB_CNTR_RESETM | USB_CNTR_CTRM |
 		USB_CNTR_SUSPM | USB_CNTR_WKUPM);
+	st_usbfs_sof_enabled = false;
 	SET_REG(USB_BCDR_REG, USB_BCDR_DPPU);
 	return &st_usbfs_dev;
 }
 
+/*
+ * The copy kernels move a word per load or store on the user buffer when it
+ * is word aligned, and fall back to byte accesses otherwise, so any buffer
+ * works on cores without unaligned access support. Both paths are unrolled
+ * so a 64 byte packet takes four (aligned) or eight (unaligned) rounds.
+ * Packet memory only takes byte and halfword accesses, so word loads from
+ * the user buffer are split into two halfword stores.
+ */
 void st_usbfs_copy_to_pm(volatile void *vPM, const void *buf, uint16_t len)
 {
-	/*
-	 * This is a bytewise copy, so it always works, even on CM0(+)
-	 * that don't support unaligned accesses.
-	 */
-	const uint8_t *lbuf = buf;
 	volatile uint16_t *PM = vPM;
-	uint32_t i;
-	for (i = 0; i < len; i += 2) {
-		*PM++ = (uint16_t)lbuf[i+1] << 8 | lbuf[i];
+	const uint8_t *lbuf;
+	uint8_t odd = len & 1;
+
+	len >>= 1;
+	if (((uintptr_t) buf & 0x03) == 0) {
+		const uint32_t *wbuf = buf;
+
+		for (; len >= 8; len -= 8, PM += 8, wbuf += 4) {
+			uint32_t w0 = wbuf[0];
+			uint32_t w1 = wbuf[1];
+			uint32_t w2 = wbuf[2];
+			uint32_t w3 = wbuf[3];
+
+			PM[0] = w0;
+			PM[1] = w0 >> 16;
+			PM[2] = w1;
+			PM[3] = w1 >> 16;
+			PM[4] = w2;
+			PM[5] = w2 >> 16;
+			PM[6] = w3;
+			PM[7] = w3 >> 16;
+		}
+		buf = wbuf;
+	}
+
+	lbuf = buf;
+	for (; len >= 4; len -= 4, PM += 4, lbuf += 8) {
+		PM[0] = lbuf[0] | lbuf[1] << 8;
+		PM[1] = lbuf[2] | lbuf[3] << 8;
+		PM[2] = lbuf[4] | lbuf[5] << 8;
+		PM[3] = lbuf[6] | lbuf[7] << 8;
+	}
+	for (; len; len--, PM++, lbuf += 2) {
+		*PM = lbuf[0] | lbuf[1] << 8;
+	}
+
+	if (odd) {
+		*PM = *lbuf;
 	}
 }
 
@@ -65,23 +104,47 @@ void st_usbfs_copy_to_pm(volatile void *vPM, const void *buf, uint16_t len)
 void st_usbfs_copy_from_pm(void *buf, const volatile void *vPM, uint16_t len)
 {
 	const volatile uint16_t *PM = vPM;
+	uint8_t *lbuf;
 	uint8_t odd = len & 1;
+
 	len >>= 1;
+	if (((uintptr_t) buf & 0x03) == 0) {
+		uint32_t *wbuf = buf;
 
-	if (((uintptr_t) buf) & 0x01) {
-		for (; len; PM++, len--) {
-			uint16_t value = *PM;
-			*(uint8_t *) buf++ = value;
-			*(uint8_t *) buf++ = value >> 8;
-		}
-	} else {
-		for (; len; PM++, buf += 2, len--) {
-			*(uint16_t *) buf = *PM;
+		for (; len >= 8; len -= 8, PM += 8, wbuf += 4) {
+			wbuf[0] = PM[0] | (uint32_t)PM[1] << 16;
+			wbuf[1] = PM[2] | (uint32_t)PM[3] << 16;
+			wbuf[2] = PM[4] | (uint32_t)PM[5] << 16;
+			wbuf[3] = PM[6] | (uint32_t)PM[7] << 16;
 		}
+		buf = wbuf;
+	}
+
+	lbuf = buf;
+	for (; len >= 4; len -= 4, PM += 4, lbuf += 8) {
+		uint16_t h0 = PM[0];
+		uint16_t h1 = PM[1];
+		uint16_t h2 = PM[2];
+		uint16_t h3 = PM[3];
+
+		lbuf[0] = h0;
+		lbuf[1] = h0 >> 8;
+		lbuf[2] = h1;
+		lbuf[3] = h1 >> 8;
+		lbuf[4] = h2;
+		lbuf[5] = h2 >> 8;
+		lbuf[6] = h3;
+		lbuf[7] = h3 >> 8;
+	}
+	for (; len; len--, PM++, lbuf += 2) {
+		uint16_t value = *PM;
+
+		lbuf[0] = value;
+		lbuf[1] = value >> 8;
 	}
 
 	if (odd) {
-		*(uint8_t *) buf = *(uint8_t *) PM;
+		*lbuf = *PM;
 	}
 }
 
@@ -114,6 +114,7 @@ void _usbd_reset(usbd_device *usbd_dev)
 {
 	usbd_dev->current_address = 0;
 	usbd_dev->current_config = 0;
+	_usbd_transfer_reset(usbd_dev);
 	usbd_ep_setup(usbd_dev, 0, USB_ENDPOINT_ATTR_CONTROL, usbd_dev->desc->bMaxPacketSize0, NULL);
 	usbd_dev->driver->set_address(usbd_dev, 0);
 
@@ -137,10 +138,33 @@ __attribute__((weak)) void usbd_disconnect(usbd_device *usbd_dev,
 	}
 }
 
-void usbd_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
-		   uint16_t max_size, usbd_endpoint_callback callback)
+enum usbd_speed usbd_get_speed(usbd_device *usbd_dev)
 {
-	usbd_dev->driver->ep_setup(usbd_dev, addr, type, max_size, callback);
+	return usbd_dev->speed;
+}
+
+uint16_t _usbd_ep_max_size(uint8_t type, uint16_t max_size,
+			   enum usbd_speed speed)
+{
+	if ((type & USB_ENDPOINT_ATTR_TYPE) != USB_ENDPOINT_ATTR_BULK) {
+		return max_size;
+	}
+	return speed == USBD_SPEED_HIGH ? 512 : MIN(max_size, 64);
+}
+
+int usbd_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
+		  uint16_t max_size, usbd_endpoint_callback callback)
+{
+	max_size = _usbd_ep_max_size(type, max_size, usbd_dev->speed);
+
+	if (addr & 0x7f) {
+		usbd_ep_transfer_cancel(usbd_dev, addr);
+		usbd_dev->transfer[addr & 0x7f][(addr & 0x80) ?
+			USB_TRANSACTION_IN : USB_TRANSACTION_OUT].max_size =
+			max_size;
+	}
+
+	return usbd_dev->driver->ep_setup(usbd_dev, addr, type, max_size, callback);
 }
 
 uint16_t usbd_ep_write_packet(usbd_device *usbd_dev, uint8_t addr,
@@ -30,12 +30,82 @@
 #define dev_base_address (usbd_dev->driver->base_address)
 #define REBASE(x)        MMIO32((x) + (dev_base_address))
 
+/*
+ * In DMA mode the core moves packet data between its FIFOs and memory
+ * itself. The packet interface goes through a word aligned bounce buffer per
+ * endpoint direction, as the caller may reuse its buffer right away.
+ */
+static uint32_t *dwc_dma_alloc(usbd_device *usbd_dev, uint16_t size)
+{
+	uint32_t *buf = usbd_dev->dma_mem + usbd_dev->dma_mem_top;
+
+	size = (size + 3) / 4;
+	if (usbd_dev->dma_mem_top + size > usbd_dev->dma_mem_size) {
+		return NULL;
+	}
+	usbd_dev->dma_mem_top += size;
+	return buf;
+}
+
+static void dwc_dma_out_arm(usbd_device *usbd_dev, uint8_t ep)
+{
+	REBASE(OTG_DOEPDMA(ep)) =
+		(uint32_t)usbd_dev->dma_buf[ep][USB_TRANSACTION_OUT];
+	REBASE(OTG_DOEPTSIZ(ep)) = usbd_dev->doeptsiz[ep];
+	REBASE(OTG_DOEPCTL(ep)) |= OTG_DOEPCTL0_EPENA |
+		(usbd_dev->force_nak[ep] ?
+		 OTG_DOEPCTL0_SNAK : OTG_DOEPCTL0_CNAK);
+}
+
+/*
+ * Receive FIFO for the current configuration, sized the way the reference
+ * manual asks for: SETUP packets, two of the largest OUT packets with their
+ * status words, a transfer complete word per OUT endpoint and global OUT NAK.
+ */
+static uint16_t dwc_rx_fifo_size(usbd_device *usbd_dev)
+{
+	const struct usb_config_descriptor *cfg;
+	uint16_t max_size = usbd_dev->desc->bMaxPacketSize0;
+	uint16_t n_out = 1;
+	int i, j, k;
+
+	if (!usbd_dev->current_config) {
+		return usbd_dev->driver->rx_fifo_size;
+	}
+
+	cfg = &usbd_dev->config[usbd_dev->current_config - 1];
+	for (i = 0; i < cfg->bNumInterfaces; i++) {
+		for (j = 0; j < cfg->interface[i].num_altsetting; j++) {
+			const struct usb_interface_descriptor *iface =
+					&cfg->interface[i].altsetting[j];
+			for (k = 0; k < iface->bNumEndpoints; k++) {
+				const struct usb_endpoint_descriptor *ep =
+					&iface->endpoint[k];
+				uint16_t size;
+
+				if (ep->bEndpointAddress & 0x80) {
+					continue;
+				}
+				size = _usbd_ep_max_size(ep->bmAttributes,
+						ep->wMaxPacketSize & 0x7ff,
+						usbd_dev->speed);
+				if (size > max_size) {
+					max_size = size;
+				}
+				n_out++;
+			}
+		}
+	}
+
+	return 5 + 8 + 2 * ((max_size + 3) / 4 + 1) + 2 * n_out + 1;
+}
+
 void dwc_set_address(usbd_device *usbd_dev, uint8_t addr)
 {
 	REBASE(OTG_DCFG) = (REBASE(OTG_DCFG) & ~OTG_DCFG_DAD) | (addr << 4);
 }
 
-void dwc_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
+int dwc_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 			uint16_t max_size,
 			void (*callback) (usbd_device *usbd_dev, uint8_t ep))
 {
@@ -44,9 +114,26 @@ void dwc_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 	 * endpoint. Install callback function.
 	 */
 	uint8_t dir = addr & 0x80;
+	uint16_t depth = 0;
 	addr &= 0x7f;
+	/* Double buffering is not supported, drop the flag. */
+	type &= USB_ENDPOINT_ATTR_TYPE;
 
 	if (addr == 0) { /* For the default control endpoint */
+		if (usbd_dev->dma) {
+			/* Room for three back to back SETUP packets. */
+			usbd_dev->dma_buf[0][USB_TRANSACTION_IN] =
+				dwc_dma_alloc(usbd_dev, max_size);
+			usbd_dev->dma_buf[0][USB_TRANSACTION_OUT] =
+				dwc_dma_alloc(usbd_dev,
+					      max_size < 24 ? 24 : max_size);
+			usbd_dev->dma_mem_top_ep0 = usbd_dev->dma_mem_top;
+			REBASE(OTG_DIEPDMA(0)) =
+				(uint32_t)usbd_dev->dma_buf[0][USB_TRANSACTION_IN];
+			REBASE(OTG_DOEPDMA(0)) =
+				(uint32_t)usbd_dev->dma_buf[0][USB_TRANSACTION_OUT];
+		}
+
 		/* Configure IN part. */
 		if (max_size >= 64) {
 			REBASE(OTG_DIEPCTL0) = OTG_DIEPCTL0_MPSIZ_64;
@@ -64,28 +151,67 @@ void dwc_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 			OTG_DIEPCTL0_EPENA | OTG_DIEPCTL0_SNAK;
 
 		/* Configure OUT part. */
-		usbd_dev->doeptsiz[0] = OTG_DIEPSIZ0_STUPCNT_1 |
+		usbd_dev->doeptsiz[0] = (usbd_dev->dma ?
+			OTG_DIEPSIZ0_STUPCNT_3 : OTG_DIEPSIZ0_STUPCNT_1) |
 			OTG_DIEPSIZ0_PKTCNT |
 			(max_size & OTG_DIEPSIZ0_XFRSIZ_MASK);
 		REBASE(OTG_DOEPTSIZ(0)) = usbd_dev->doeptsiz[0];
 		REBASE(OTG_DOEPCTL(0)) |=
 		    OTG_DOEPCTL0_EPENA | OTG_DIEPCTL0_SNAK;
 
+		REBASE(OTG_GRXFSIZ) = usbd_dev->driver->rx_fifo_size;
 		REBASE(OTG_GNPTXFSIZ) = ((max_size / 4) << 16) |
 					 usbd_dev->driver->rx_fifo_size;
 		usbd_dev->fifo_mem_top += max_size / 4;
 		usbd_dev->fifo_mem_top_ep0 = usbd_dev->fifo_mem_top;
 
-		return;
+		return 0;
+	}
+
+	/* DMA state is only kept for the endpoints dwc_poll() services. */
+	if (usbd_dev->dma && addr > 3) {
+		return -1;
+	}
+
+	if (dir) {
+		const uint16_t fifo_size = usbd_dev->driver->fifo_size;
+
+		depth = (max_size + 3) / 4;
+		/* At high speed a second bulk packet keeps the bus busy. */
+		if (usbd_dev->speed == USBD_SPEED_HIGH &&
+		    type == USB_ENDPOINT_ATTR_BULK &&
+		    (!fifo_size ||
+		     usbd_dev->fifo_mem_top + 2 * depth <= fifo_size)) {
+			depth *= 2;
+		}
+		if (fifo_size && usbd_dev->fifo_mem_top + depth > fifo_size) {
+			return -1;
+		}
+	}
+
+	if (usbd_dev->dma) {
+		uint8_t idx = dir ? USB_TRANSACTION_IN : USB_TRANSACTION_OUT;
+		uint32_t *buf = dwc_dma_alloc(usbd_dev, max_size);
+
+		if (!buf) {
+			return -1;
+		}
+		usbd_dev->dma_buf[addr][idx] = buf;
+		usbd_dev->dma_xfer_len[addr][idx] = 0;
+		if (dir) {
+			REBASE(OTG_DIEPDMA(addr)) = (uint32_t)buf;
+		} else {
+			REBASE(OTG_DOEPDMA(addr)) = (uint32_t)buf;
+		}
 	}
 
 	if (dir) {
-		REBASE(OTG_DIEPTXF(addr)) = ((max_size / 4) << 16) |
+		REBASE(OTG_DIEPTXF(addr)) = (depth << 16) |
 					     usbd_dev->fifo_mem_top;
-		usbd_dev->fifo_mem_top += max_size / 4;
+		usbd_dev->fifo_mem_top += depth;
 
 		REBASE(OTG_DIEPTSIZ(addr)) =
-		    (max_size & OTG_DIEPSIZ0_XFRSIZ_MASK);
+		    (max_size & OTG_DIEPSIZX_XFRSIZ_MASK);
 		REBASE(OTG_DIEPCTL(addr)) |=
 		    OTG_DIEPCTL0_EPENA | OTG_DIEPCTL0_SNAK | (type << 18)
 		    | OTG_DIEPCTL0_USBAEP | OTG_DIEPCTLX_SD0PID
@@ -99,7 +225,7 @@ void dwc_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 
 	if (!dir) {
 		usbd_dev->doeptsiz[addr] = OTG_DIEPSIZ0_PKTCNT |
-				 (max_size & OTG_DIEPSIZ0_XFRSIZ_MASK);
+				 (max_size & OTG_DIEPSIZX_XFRSIZ_MASK);
 		REBASE(OTG_DOEPTSIZ(addr)) = usbd_dev->doeptsiz[addr];
 		REBASE(OTG_DOEPCTL(addr)) |= OTG_DOEPCTL0_EPENA |
 		    OTG_DOEPCTL0_USBAEP | OTG_DIEPCTL0_CNAK |
@@ -110,16 +236,32 @@ void dwc_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 			    (void *)callback;
 		}
 	}
+
+	return 0;
 }
 
 void dwc_endpoints_reset(usbd_device *usbd_dev)
 {
 	int i;
+
+	if (usbd_dev->speed == USBD_SPEED_HIGH) {
+		/* Leave the transmit FIFOs what OUT endpoints don't need. */
+		uint16_t rx = dwc_rx_fifo_size(usbd_dev);
+		uint16_t ep0 = REBASE(OTG_GNPTXFSIZ) >> 16;
+
+		REBASE(OTG_GRXFSIZ) = rx;
+		REBASE(OTG_GNPTXFSIZ) = (ep0 << 16) | rx;
+		usbd_dev->fifo_mem_top_ep0 = rx + ep0;
+	}
+
 	/* The core resets the endpoints automatically on reset. */
 	usbd_dev->fifo_mem_top = usbd_dev->fifo_mem_top_ep0;
+	usbd_dev->dma_mem_top = usbd_dev->dma_mem_top_ep0;
 
 	/* Disable any currently active endpoints */
 	for (i = 1; i < 4; i++) {
+		usbd_dev->dma_xfer_len[i][USB_TRANSACTION_IN] = 0;
+		usbd_dev->dma_xfer_len[i][USB_TRANSACTION_OUT] = 0;
 		if (REBASE(OTG_DOEPCTL(i)) & OTG_DOEPCTL0_EPENA) {
 			REBASE(OTG_DOEPCTL(i)) |= OTG_DOEPCTL0_EPDIS;
 		}
@@ -207,6 +349,19 @@ uint16_t dwc_ep_write_packet(usbd_device *usbd_dev, uint8_t addr,
 		return 0;
 	}
 
+	if (usbd_dev->dma) {
+		uint32_t *dma_buf = usbd_dev->dma_buf[addr][USB_TRANSACTION_IN];
+
+		if (len) {
+			memcpy(dma_buf, buf, len);
+		}
+		REBASE(OTG_DIEPDMA(addr)) = (uint32_t)dma_buf;
+		REBASE(OTG_DIEPTSIZ(addr)) = OTG_DIEPSIZ0_PKTCNT | len;
+		REBASE(OTG_DIEPCTL(addr)) |= OTG_DIEPCTL0_EPENA |
+					     OTG_DIEPCTL0_CNAK;
+		return len;
+	}
+
 	/* Enable endpoint for transmission. */
 	REBASE(OTG_DIEPTSIZ(addr)) = OTG_DIEPSIZ0_PKTCNT | len;
 	REBASE(OTG_DIEPCTL(addr)) |= OTG_DIEPCTL0_EPENA |
@@ -249,12 +404,16 @@ uint16_t dwc_ep_read_packet(usbd_device *usbd_dev, uint8_t addr,
 #endif /* defined(__ARM_ARCH_6M__) */
 	uint32_t extra;
 
-	/* We do not need to know the endpoint address since there is only one
-	 * receive FIFO for all endpoints.
-	 */
-	(void) addr;
 	len = MIN(len, usbd_dev->rxbcnt);
 
+	if (usbd_dev->dma) {
+		/* The packet is in the bounce buffer, the rest is dropped. */
+		memcpy(buf, usbd_dev->dma_buf[addr & 0x7f][USB_TRANSACTION_OUT],
+		       len);
+		usbd_dev->rxbcnt = 0;
+		return len;
+	}
+
 	/* ARMv7M supports non-word-aligned accesses, ARMv6M does not. */
 #if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
 	for (i = len; i >= 4; i -= 4) {
@@ -321,6 +480,178 @@ static void dwc_flush_txfifo(usbd_device *usbd_dev, int ep)
 	}
 }
 
+int dwc_ep_transfer(usbd_device *usbd_dev, uint8_t addr, void *buf,
+		    uint32_t len)
+{
+	uint8_t ep = addr & 0x7f;
+	uint8_t dir = (addr & 0x80) ? USB_TRANSACTION_IN : USB_TRANSACTION_OUT;
+	uint16_t max_size = usbd_dev->transfer[ep][dir].max_size;
+	uint32_t pkts;
+
+	if (!usbd_dev->dma || ep > 3) {
+		return -1;
+	}
+	/* The packet path must not see the state of an earlier transfer. */
+	usbd_dev->dma_xfer_len[ep][dir] = 0;
+
+	/* The DMA engine works on words, anything else takes packets. */
+	if (!len || ((uint32_t)buf & 3) ||
+	    (max_size & 3) || len > OTG_DIEPSIZX_XFRSIZ_MASK) {
+		return -1;
+	}
+	pkts = (len + max_size - 1) / max_size;
+	if (pkts > (OTG_DIEPSIZX_PKTCNT_MASK >> OTG_DIEPSIZX_PKTCNT_SHIFT)) {
+		return -1;
+	}
+
+	if (dir == USB_TRANSACTION_IN) {
+		if (REBASE(OTG_DIEPTSIZ(ep)) & OTG_DIEPSIZX_PKTCNT_MASK) {
+			return -1;
+		}
+		usbd_dev->dma_xfer_len[ep][dir] = len;
+		REBASE(OTG_DIEPDMA(ep)) = (uint32_t)buf;
+		REBASE(OTG_DIEPTSIZ(ep)) =
+			(pkts << OTG_DIEPSIZX_PKTCNT_SHIFT) | len;
+		REBASE(OTG_DIEPCTL(ep)) |= OTG_DIEPCTL0_EPENA |
+					   OTG_DIEPCTL0_CNAK;
+		return 0;
+	}
+
+	/*
+	 * Whole packets only: the core stores a short packet in whole words.
+	 * The endpoint is already armed into its bounce buffer, so the first
+	 * packet lands there and the rest is received in place, see
+	 * dwc_dma_out_done().
+	 */
+	if (len % max_size) {
+		return -1;
+	}
+	usbd_dev->dma_xfer_buf[ep][dir] = buf;
+	usbd_dev->dma_xfer_len[ep][dir] = len;
+	usbd_dev->dma_xfer_done[ep][dir] = 0;
+	return 0;
+}
+
+/*
+ * Stop the DMA engine on a dropped transfer. An OUT endpoint goes back to
+ * its bounce buffer, data the core already took for the transfer is lost.
+ */
+void dwc_ep_transfer_cancel(usbd_device *usbd_dev, uint8_t addr)
+{
+	uint8_t ep = addr & 0x7f;
+	uint8_t dir = (addr & 0x80) ? USB_TRANSACTION_IN : USB_TRANSACTION_OUT;
+
+	if (!usbd_dev->dma || ep > 3 || !usbd_dev->dma_xfer_len[ep][dir]) {
+		return;
+	}
+	usbd_dev->dma_xfer_len[ep][dir] = 0;
+
+	if (dir == USB_TRANSACTION_IN) {
+		if (REBASE(OTG_DIEPCTL(ep)) & OTG_DIEPCTL0_EPENA) {
+			REBASE(OTG_DIEPCTL(ep)) |= OTG_DIEPCTL0_SNAK;
+			while (!(REBASE(OTG_DIEPINT(ep)) &
+				 OTG_DIEPINTX_INEPNE)) {
+				/* idle */
+			}
+			REBASE(OTG_DIEPCTL(ep)) |= OTG_DIEPCTL0_EPDIS |
+						   OTG_DIEPCTL0_SNAK;
+			while (!(REBASE(OTG_DIEPINT(ep)) &
+				 OTG_DIEPINTX_EPDISD)) {
+				/* idle */
+			}
+			dwc_flush_txfifo(usbd_dev, ep);
+		}
+		REBASE(OTG_DIEPINT(ep)) = OTG_DIEPINTX_EPDISD |
+					  OTG_DIEPINTX_INEPNE |
+					  OTG_DIEPINTX_XFRC;
+		return;
+	}
+
+	/* Still waiting for the first packet in the bounce buffer. */
+	if (!usbd_dev->dma_xfer_done[ep][dir]) {
+		return;
+	}
+	usbd_dev->dma_xfer_done[ep][dir] = 0;
+
+	if (REBASE(OTG_DOEPCTL(ep)) & OTG_DOEPCTL0_EPENA) {
+		/* An OUT endpoint is only disabled under global OUT NAK. */
+		REBASE(OTG_DCTL) |= OTG_DCTL_SGONAK;
+		while (!(REBASE(OTG_GINTSTS) & OTG_GINTSTS_GONAKEFF)) {
+			/* idle */
+		}
+		REBASE(OTG_DOEPCTL(ep)) |= OTG_DOEPCTL0_EPDIS |
+					   OTG_DOEPCTL0_SNAK;
+		while (!(REBASE(OTG_DOEPINT(ep)) & OTG_DOEPINTX_EPDISD)) {
+			/* idle */
+		}
+		REBASE(OTG_DCTL) |= OTG_DCTL_CGONAK;
+	}
+	REBASE(OTG_DOEPINT(ep)) = OTG_DOEPINTX_EPDISD | OTG_DOEPINTX_XFRC;
+	dwc_dma_out_arm(usbd_dev, ep);
+}
+
+static void dwc_dma_out_done(usbd_device *usbd_dev, uint8_t ep)
+{
+	const uint8_t dir = USB_TRANSACTION_OUT;
+	uint32_t left = REBASE(OTG_DOEPTSIZ(ep)) & OTG_DIEPSIZX_XFRSIZ_MASK;
+	uint32_t size = usbd_dev->doeptsiz[ep] & OTG_DIEPSIZX_XFRSIZ_MASK;
+	uint32_t len = usbd_dev->dma_xfer_len[ep][dir];
+	uint32_t done = usbd_dev->dma_xfer_done[ep][dir];
+	uint8_t *buf = usbd_dev->dma_xfer_buf[ep][dir];
+	uint32_t rx;
+
+	if (!len) {
+		usbd_dev->rxbcnt = size - left;
+		if (usbd_dev->user_callback_ctr[ep][dir]) {
+			usbd_dev->user_callback_ctr[ep][dir](usbd_dev, ep);
+		}
+		usbd_dev->rxbcnt = 0;
+		dwc_dma_out_arm(usbd_dev, ep);
+		return;
+	}
+
+	if (done) {
+		/* The rest of the transfer, a short packet ends it early. */
+		done = len - left;
+	} else {
+		rx = size - left;
+		memcpy(buf, usbd_dev->dma_buf[ep][dir], rx);
+		done = rx;
+		if (rx == size && done < len) {
+			/* Receive the rest straight into the transfer buffer. */
+			usbd_dev->dma_xfer_done[ep][dir] = done;
+			REBASE(OTG_DOEPDMA(ep)) = (uint32_t)(buf + done);
+			REBASE(OTG_DOEPTSIZ(ep)) =
+				(((len - done) / size) <<
+				 OTG_DIEPSIZX_PKTCNT_SHIFT) | (len - done);
+			REBASE(OTG_DOEPCTL(ep)) |= OTG_DOEPCTL0_EPENA |
+				(usbd_dev->force_nak[ep] ?
+				 OTG_DOEPCTL0_SNAK : OTG_DOEPCTL0_CNAK);
+			return;
+		}
+	}
+
+	/* Arm after the callback, it may queue the next transfer or NAK. */
+	usbd_dev->dma_xfer_len[ep][dir] = 0;
+	_usbd_transfer_done(usbd_dev, ep, done);
+	dwc_dma_out_arm(usbd_dev, ep);
+}
+
+static void dwc_dma_setup(usbd_device *usbd_dev, uint8_t ep)
+{
+	/* The core moves DOEPDMA past each SETUP packet it stores. */
+	const uint8_t *req = (const uint8_t *)REBASE(OTG_DOEPDMA(ep)) - 8;
+
+	if (REBASE(OTG_DIEPTSIZ(ep)) & OTG_DIEPSIZ0_PKTCNT) {
+		/* Something is still stuck in the transmit fifo. */
+		dwc_flush_txfifo(usbd_dev, ep);
+	}
+
+	memcpy(&usbd_dev->control_state.req, req, 8);
+	usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_SETUP](usbd_dev, ep);
+	dwc_dma_out_arm(usbd_dev, ep);
+}
+
 void dwc_poll(usbd_device *usbd_dev)
 {
 	/* Read interrupt status register. */
@@ -331,6 +662,13 @@ void dwc_poll(usbd_device *usbd_dev)
 		/* Handle USB RESET condition. */
 		REBASE(OTG_GINTSTS) = OTG_GINTSTS_ENUMDNE;
 		usbd_dev->fifo_mem_top = usbd_dev->driver->rx_fifo_size;
+		usbd_dev->dma_mem_top = 0;
+		if ((REBASE(OTG_DSTS) & OTG_DSTS_ENUMSPD_MASK) ==
+		    OTG_DSTS_ENUMSPD_HS) {
+			usbd_dev->speed = USBD_SPEED_HIGH;
+		} else {
+			usbd_dev->speed = USBD_SPEED_FULL;
+		}
 		_usbd_reset(usbd_dev);
 		return;
 	}
@@ -342,7 +680,13 @@ void dwc_poll(usbd_device *usbd_dev)
 	for (i = 0; i < 4; i++) { /* Iterate over endpoints. */
 		if (REBASE(OTG_DIEPINT(i)) & OTG_DIEPINTX_XFRC) {
 			/* Transfer complete. */
-			if (usbd_dev->user_callback_ctr[i]
+			if (usbd_dev->dma_xfer_len[i][USB_TRANSACTION_IN]) {
+				uint32_t len =
+				    usbd_dev->dma_xfer_len[i][USB_TRANSACTION_IN];
+
+				usbd_dev->dma_xfer_len[i][USB_TRANSACTION_IN] = 0;
+				_usbd_transfer_done(usbd_dev, i | 0x80, len);
+			} else if (usbd_dev->user_callback_ctr[i]
 						       [USB_TRANSACTION_IN]) {
 				usbd_dev->user_callback_ctr[i]
 					[USB_TRANSACTION_IN](usbd_dev, i);
@@ -352,8 +696,22 @@ void dwc_poll(usbd_device *usbd_dev)
 		}
 	}
 
+	/* In DMA mode OUT packets are already in memory. */
+	for (i = 0; usbd_dev->dma && i < 4; i++) {
+		uint32_t doepint = REBASE(OTG_DOEPINT(i));
+
+		if (doepint & OTG_DOEPINTX_XFRC) {
+			REBASE(OTG_DOEPINT(i)) = OTG_DOEPINTX_XFRC;
+			dwc_dma_out_done(usbd_dev, i);
+		}
+		if (doepint & OTG_DOEPINTX_STUP) {
+			REBASE(OTG_DOEPINT(i)) = OTG_DOEPINTX_STUP;
+			dwc_dma_setup(usbd_dev, i);
+		}
+	}
+
 	/* Note: RX and TX handled differently in this device. */
-	if (intsts & OTG_GINTSTS_RXFLVL) {
+	if (!usbd_dev->dma && (intsts & OTG_GINTSTS_RXFLVL)) {
 		/* Receive FIFO non-empty. */
 		uint32_t rxstsp = REBASE(OTG_GRXSTSP);
 		uint32_t pktsts = rxstsp & OTG_GRXSTSP_PKTSTS_MASK;
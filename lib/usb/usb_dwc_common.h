@@ -21,7 +21,7 @@
 #define __USB_DWC_COMMON_H_
 
 void dwc_set_address(usbd_device *usbd_dev, uint8_t addr);
-void dwc_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
+int dwc_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 			uint16_t max_size,
 			void (*callback)(usbd_device *usbd_dev, uint8_t ep));
 void dwc_endpoints_reset(usbd_device *usbd_dev);
@@ -32,6 +32,9 @@ uint16_t dwc_ep_write_packet(usbd_device *usbd_dev, uint8_t addr,
 				   const void *buf, uint16_t len);
 uint16_t dwc_ep_read_packet(usbd_device *usbd_dev, uint8_t addr,
 				  void *buf, uint16_t len);
+int dwc_ep_transfer(usbd_device *usbd_dev, uint8_t addr, void *buf,
+		    uint32_t len);
+void dwc_ep_transfer_cancel(usbd_device *usbd_dev, uint8_t addr);
 void dwc_poll(usbd_device *usbd_dev);
 void dwc_disconnect(usbd_device *usbd_dev, bool disconnected);
 
@@ -104,7 +104,7 @@ static void efm32lg_set_address(usbd_device *usbd_dev, uint8_t addr)
 	USB_DCFG = (USB_DCFG & ~USB_DCFG_DAD) | (addr << 4);
 }
 
-static void efm32lg_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
+static int efm32lg_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 			uint16_t max_size,
 			void (*callback) (usbd_device *usbd_dev, uint8_t ep))
 {
@@ -114,6 +114,8 @@ static void efm32lg_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 	 */
 	uint8_t dir = addr & 0x80;
 	addr &= 0x7f;
+	/* Double buffering is not supported, drop the flag. */
+	type &= USB_ENDPOINT_ATTR_TYPE;
 
 	if (addr == 0) { /* For the default control endpoint */
 		/* Configure IN part. */
@@ -145,7 +147,7 @@ static void efm32lg_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 		usbd_dev->fifo_mem_top += max_size / 4;
 		usbd_dev->fifo_mem_top_ep0 = usbd_dev->fifo_mem_top;
 
-		return;
+		return 0;
 	}
 
 	if (dir) {
@@ -179,6 +181,8 @@ static void efm32lg_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 			    (void *)callback;
 		}
 	}
+
+	return 0;
 }
 
 static void efm32lg_endpoints_reset(usbd_device *usbd_dev)
@@ -28,6 +28,8 @@
 
 /* Receive FIFO size in 32-bit words. */
 #define RX_FIFO_SIZE 128
+/* Total FIFO RAM in 32-bit words. */
+#define FIFO_SIZE 320
 
 static usbd_device *stm32f107_usbd_init(void);
 
@@ -48,6 +50,7 @@ const struct _usbd_driver stm32f107_usb_driver = {
 	.base_address = USB_OTG_FS_BASE,
 	.set_address_before_status = 1,
 	.rx_fifo_size = RX_FIFO_SIZE,
+	.fifo_size = FIFO_SIZE,
 };
 
 /** Initialize the USB device controller hardware of the STM32. */
@@ -28,10 +28,18 @@
 
 /* Receive FIFO size in 32-bit words. */
 #define RX_FIFO_SIZE 512
+/* Total FIFO RAM in 32-bit words. */
+#define FIFO_SIZE 1024
+/* Bounce buffers of the DMA mode in 32-bit words. */
+#define DMA_MEM_SIZE 512
 
 static usbd_device *stm32f207_usbd_init(void);
+static usbd_device *stm32f207_usbd_init_dma(void);
+static usbd_device *stm32f207_usbd_init_hs(void);
+static usbd_device *stm32f207_usbd_init_hs_dma(void);
 
 static struct _usbd_device usbd_dev;
+static uint32_t dma_mem[DMA_MEM_SIZE];
 
 const struct _usbd_driver stm32f207_usb_driver = {
 	.init = stm32f207_usbd_init,
@@ -48,17 +56,96 @@ const struct _usbd_driver stm32f207_usb_driver = {
 	.base_address = USB_OTG_HS_BASE,
 	.set_address_before_status = 1,
 	.rx_fifo_size = RX_FIFO_SIZE,
+	.fifo_size = FIFO_SIZE,
+};
+
+/*
+ * Same core with its internal DMA engine doing the FIFO copies. Transfer
+ * buffers must be reachable by the DMA engine, that is not in CCM RAM, and
+ * kept coherent by the application on parts with a data cache.
+ */
+const struct _usbd_driver stm32f207_dma_usb_driver = {
+	.init = stm32f207_usbd_init_dma,
+	.set_address = dwc_set_address,
+	.ep_setup = dwc_ep_setup,
+	.ep_reset = dwc_endpoints_reset,
+	.ep_stall_set = dwc_ep_stall_set,
+	.ep_stall_get = dwc_ep_stall_get,
+	.ep_nak_set = dwc_ep_nak_set,
+	.ep_write_packet = dwc_ep_write_packet,
+	.ep_read_packet = dwc_ep_read_packet,
+	.poll = dwc_poll,
+	.ep_transfer = dwc_ep_transfer,
+	.ep_transfer_cancel = dwc_ep_transfer_cancel,
+	.disconnect = dwc_disconnect,
+	.base_address = USB_OTG_HS_BASE,
+	.set_address_before_status = 1,
+	.rx_fifo_size = RX_FIFO_SIZE,
+	.fifo_size = FIFO_SIZE,
+};
+
+/* High speed through an external ULPI PHY, in FIFO and in DMA mode. */
+const struct _usbd_driver stm32f207_hs_usb_driver = {
+	.init = stm32f207_usbd_init_hs,
+	.set_address = dwc_set_address,
+	.ep_setup = dwc_ep_setup,
+	.ep_reset = dwc_endpoints_reset,
+	.ep_stall_set = dwc_ep_stall_set,
+	.ep_stall_get = dwc_ep_stall_get,
+	.ep_nak_set = dwc_ep_nak_set,
+	.ep_write_packet = dwc_ep_write_packet,
+	.ep_read_packet = dwc_ep_read_packet,
+	.poll = dwc_poll,
+	.disconnect = dwc_disconnect,
+	.base_address = USB_OTG_HS_BASE,
+	.set_address_before_status = 1,
+	.rx_fifo_size = RX_FIFO_SIZE,
+	.fifo_size = FIFO_SIZE,
+	.high_speed = 1,
+};
+
+const struct _usbd_driver stm32f207_hs_dma_usb_driver = {
+	.init = stm32f207_usbd_init_hs_dma,
+	.set_address = dwc_set_address,
+	.ep_setup = dwc_ep_setup,
+	.ep_reset = dwc_endpoints_reset,
+	.ep_stall_set = dwc_ep_stall_set,
+	.ep_stall_get = dwc_ep_stall_get,
+	.ep_nak_set = dwc_ep_nak_set,
+	.ep_write_packet = dwc_ep_write_packet,
+	.ep_read_packet = dwc_ep_read_packet,
+	.poll = dwc_poll,
+	.ep_transfer = dwc_ep_transfer,
+	.ep_transfer_cancel = dwc_ep_transfer_cancel,
+	.disconnect = dwc_disconnect,
+	.base_address = USB_OTG_HS_BASE,
+	.set_address_before_status = 1,
+	.rx_fifo_size = RX_FIFO_SIZE,
+	.fifo_size = FIFO_SIZE,
+	.high_speed = 1,
 };
 
 /** Initialize the USB device controller hardware of the STM32. */
-static usbd_device *stm32f207_usbd_init(void)
+static void stm32f207_usbd_init_core(bool ulpi)
 {
 	rcc_periph_clock_enable(RCC_OTGHS);
 	OTG_HS_GINTSTS = OTG_GINTSTS_MMIS;
 
-	OTG_HS_GUSBCFG |= OTG_GUSBCFG_PHYSEL;
-	/* Enable VBUS sensing in device mode and power down the PHY. */
-	OTG_HS_GCCFG |= OTG_GCCFG_VBUSBSEN | OTG_GCCFG_PWRDWN;
+	if (ulpi) {
+		rcc_periph_clock_enable(RCC_OTGHSULPI);
+		/* External PHY, VBUS is handled by the PHY. */
+		OTG_HS_GUSBCFG &= ~(OTG_GUSBCFG_PHYSEL | OTG_GUSBCFG_TSDPS |
+				    OTG_GUSBCFG_ULPIFSLS |
+				    OTG_GUSBCFG_ULPIEVBUSD |
+				    OTG_GUSBCFG_ULPIEVBUSI);
+	} else {
+		OTG_HS_GUSBCFG |= OTG_GUSBCFG_PHYSEL;
+		/*
+		 * Enable VBUS sensing in device mode and power down the
+		 * PHY.
+		 */
+		OTG_HS_GCCFG |= OTG_GCCFG_VBUSBSEN | OTG_GCCFG_PWRDWN;
+	}
 
 	/* Wait for AHB idle. */
 	while (!(OTG_HS_GRSTCTL & OTG_GRSTCTL_AHBIDL));
@@ -67,16 +154,24 @@ static usbd_device *stm32f207_usbd_init(void)
 	while (OTG_HS_GRSTCTL & OTG_GRSTCTL_CSRST);
 
 	/* Force peripheral only mode. */
-	OTG_HS_GUSBCFG |= OTG_GUSBCFG_FDMOD | OTG_GUSBCFG_TRDT_MASK;
-
-	/* Full speed device. */
-	OTG_HS_DCFG |= OTG_DCFG_DSPD;
+	if (ulpi) {
+		OTG_HS_GUSBCFG = (OTG_HS_GUSBCFG & ~OTG_GUSBCFG_TRDT_MASK) |
+				 OTG_GUSBCFG_FDMOD |
+				 (0x9 << OTG_GUSBCFG_TRDT_SHIFT);
+		/* High speed device. */
+		OTG_HS_DCFG &= ~OTG_DCFG_DSPD;
+	} else {
+		OTG_HS_GUSBCFG |= OTG_GUSBCFG_FDMOD | OTG_GUSBCFG_TRDT_MASK;
+		/* Full speed device. */
+		OTG_HS_DCFG |= OTG_DCFG_DSPD;
+	}
 
 	/* Restart the PHY clock. */
 	OTG_HS_PCGCCTL = 0;
 
 	OTG_HS_GRXFSIZ = stm32f207_usb_driver.rx_fifo_size;
 	usbd_dev.fifo_mem_top = stm32f207_usb_driver.rx_fifo_size;
+	usbd_dev.speed = USBD_SPEED_FULL;
 
 	/* Unmask interrupts for TX and RX. */
 	OTG_HS_GAHBCFG |= OTG_GAHBCFG_GINT;
@@ -87,6 +182,46 @@ static usbd_device *stm32f207_usbd_init(void)
 			 OTG_GINTMSK_WUIM;
 	OTG_HS_DAINTMSK = 0xF;
 	OTG_HS_DIEPMSK = OTG_DIEPMSK_XFRCM;
+}
+
+/* Let the internal DMA engine do the FIFO copies. */
+static void stm32f207_usbd_enable_dma(void)
+{
+	usbd_dev.dma = true;
+	usbd_dev.dma_mem = dma_mem;
+	usbd_dev.dma_mem_size = DMA_MEM_SIZE;
+	usbd_dev.dma_mem_top = 0;
+
+	/* OUT packets are reported per endpoint rather than by RXFLVL. */
+	OTG_HS_GAHBCFG |= OTG_GAHBCFG_DMAEN | OTG_GAHBCFG_HBSTLEN_INCR4;
+	OTG_HS_GINTMSK = (OTG_HS_GINTMSK & ~OTG_GINTMSK_RXFLVLM) |
+			 OTG_GINTMSK_OEPINT;
+	OTG_HS_DAINTMSK = 0xF000F;
+	OTG_HS_DOEPMSK = OTG_DOEPMSK_XFRCM | OTG_DOEPMSK_STUPM;
+}
 
+static usbd_device *stm32f207_usbd_init(void)
+{
+	stm32f207_usbd_init_core(false);
+	return &usbd_dev;
+}
+
+static usbd_device *stm32f207_usbd_init_dma(void)
+{
+	stm32f207_usbd_init_core(false);
+	stm32f207_usbd_enable_dma();
+	return &usbd_dev;
+}
+
+static usbd_device *stm32f207_usbd_init_hs(void)
+{
+	stm32f207_usbd_init_core(true);
+	return &usbd_dev;
+}
+
+static usbd_device *stm32f207_usbd_init_hs_dma(void)
+{
+	stm32f207_usbd_init_core(true);
+	stm32f207_usbd_enable_dma();
 	return &usbd_dev;
 }
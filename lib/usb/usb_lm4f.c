@@ -184,12 +184,11 @@ static void lm4f_set_address(usbd_device *usbd_dev, uint8_t addr)
 	USB_FADDR = addr & USB_FADDR_FUNCADDR_MASK;
 }
 
-static void lm4f_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
+static int lm4f_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 			  uint16_t max_size,
 			  void (*callback) (usbd_device *usbd_dev, uint8_t ep))
 {
 	(void)usbd_dev;
-	(void)type;
 
 	uint8_t reg8;
 	uint16_t fifo_size;
@@ -197,6 +196,9 @@ static void lm4f_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 	const bool dir_tx = addr & 0x80;
 	const uint8_t ep = addr & 0x0f;
 
+	/* Double buffering is not supported, drop the flag. */
+	type &= USB_ENDPOINT_ATTR_TYPE;
+
 	/*
 	 * We do not mess with the maximum packet size, but we can only allocate
 	 * the FIFO in power-of-two increments.
@@ -247,12 +249,12 @@ static void lm4f_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 		 * are always reserved for EP0.
 		 */
 		usbd_dev->fifo_mem_top_ep0 = 64;
-		return;
+		return 0;
 	}
 
 	/* Are we out of FIFO space? */
 	if (usbd_dev->fifo_mem_top + fifo_size > MAX_FIFO_RAM) {
-		return;
+		return -1;
 	}
 
 	USB_EPIDX = addr & USB_EPIDX_MASK;
@@ -287,6 +289,8 @@ static void lm4f_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 	}
 
 	usbd_dev->fifo_mem_top += fifo_size;
+
+	return 0;
 }
 
 static void lm4f_endpoints_reset(usbd_device *usbd_dev)
@@ -55,9 +55,17 @@
 #define SCSI_WRITE_6				0x0A
 #define SCSI_INQUIRY				0x12
 #define SCSI_MODE_SENSE_6			0x1A
+#define SCSI_START_STOP_UNIT			0x1B
 #define SCSI_SEND_DIAGNOSTIC			0x1D
+#define SCSI_READ_FORMAT_CAPACITIES		0x23
 #define SCSI_READ_CAPACITY			0x25
 #define SCSI_READ_10				0x28
+#define SCSI_WRITE_10				0x2A
+#define SCSI_VERIFY				0x2F
+#define SCSI_SYNCHRONIZE_CACHE			0x35
+#define SCSI_MODE_SENSE_10			0x5A
+#define SCSI_READ_12				0xA8
+#define SCSI_WRITE_12				0xAA
 
 
 /* Required SCSI Commands */
@@ -67,15 +75,7 @@
 #define SCSI_PREVENT_ALLOW_MEDIUM_REMOVAL	0x1E
 #define SCSI_MODE_SELECT_6			0x15
 #define SCSI_MODE_SELECT_10			0x55
-#define SCSI_MODE_SENSE_10			0x5A
-#define SCSI_READ_12				0xA8
-#define SCSI_READ_FORMAT_CAPACITIES		0x23
 #define SCSI_READ_TOC_PMA_ATIP			0x43
-#define SCSI_START_STOP_UNIT			0x1B
-#define SCSI_SYNCHRONIZE_CACHE			0x35
-#define SCSI_VERIFY				0x2F
-#define SCSI_WRITE_10				0x2A
-#define SCSI_WRITE_12				0xAA
 
 /* The sense codes */
 enum sbc_sense_key {
@@ -121,6 +121,13 @@ enum trans_event {
 	EVENT_NEED_STATUS
 };
 
+/* Block data phase in progress */
+enum msc_pipe {
+	MSC_PIPE_IDLE,
+	MSC_PIPE_READ,			/* Media to host */
+	MSC_PIPE_WRITE			/* Host to media */
+};
+
 struct usb_msc_cbw {
 	uint32_t dCBWSignature;
 	uint32_t dCBWTag;
@@ -144,8 +151,14 @@ struct sbc_sense_info {
 	uint8_t ascq;
 };
 
+/* Default pipeline buffers, one block each. */
+#define MSC_BLOCK_SIZE				512
+
+/* Largest erase block the write cache takes, in blocks */
+#define MSC_CACHE_MAX_BLOCKS			256
+#define MSC_CACHE_NONE				0xffffffff
+
 struct usb_msc_trans {
-	uint8_t cbw_cnt;		/* Read until 31 bytes */
 	union {
 		struct usb_msc_cbw cbw;
 		uint8_t buf[1];
@@ -158,12 +171,23 @@ struct usb_msc_trans {
 					   to bytes_to_write. */
 	uint32_t lba_start;
 	uint32_t block_count;
-	uint32_t current_block;
+	uint32_t current_block;		/* Next block for the media */
+
+	uint8_t *msd_buf;		/* Responses of the SCSI layer */
 
-	uint8_t msd_buf[512];
+	/*
+	 * Block data goes through two buffers: while one moves over USB the
+	 * media reads into or writes from the other.
+	 */
+	uint32_t buf_fill[2];		/* Blocks held by each buffer */
+	uint32_t usb_len;		/* Bytes asked of the current transfer */
+	uint8_t usb_buf;		/* Buffer moving over USB */
+	bool usb_busy;
+	uint8_t pipe;			/* enum msc_pipe */
+
+	bool data_short;		/* Data phase ended by a short packet */
+	uint32_t drained;		/* OUT bytes the command did not want */
 
-	bool csw_valid;
-	uint8_t csw_sent;		/* Write until 13 bytes */
 	union {
 		struct usb_msc_csw csw;
 		uint8_t buf[1];
@@ -184,6 +208,38 @@ struct _usbd_mass_storage {
 
 	int (*read_block)(uint32_t lba, uint8_t *copy_to);
 	int (*write_block)(uint32_t lba, const uint8_t *copy_from);
+	int (*read_blocks)(uint32_t lba, uint8_t *copy_to, uint32_t count);
+	int (*write_blocks)(uint32_t lba, const uint8_t *copy_from,
+			    uint32_t count);
+	void (*start_read)(uint32_t lba, uint8_t *copy_to, uint32_t count);
+	void (*start_write)(uint32_t lba, const uint8_t *copy_from,
+			    uint32_t count);
+
+	uint8_t *buf[2];
+	uint32_t buf_blocks;		/* Blocks per buffer */
+
+	/*
+	 * One media operation at a time. An operation still running when
+	 * the host resets the device is stale: its result is dropped and
+	 * the next CBW waits for it.
+	 */
+	bool media_busy;
+	bool media_stale;
+	uint8_t media_buf;
+	uint32_t media_count;
+
+	/*
+	 * Write-back cache of one erase block. Writes land here and go to the
+	 * backend as a whole erase block, blocks the host did not write read
+	 * back from the media first.
+	 */
+	uint8_t *cache;
+	uint32_t cache_blocks;		/* Blocks per erase block */
+	uint32_t cache_lba;		/* First block cached, or NONE */
+	uint32_t cache_valid[MSC_CACHE_MAX_BLOCKS / 32];
+	bool cache_dirty;
+	uint16_t cache_idle;		/* Ticks since the last write */
+	uint16_t cache_timeout;
 
 	void (*lock)(void);
 	void (*unlock)(void);
@@ -193,6 +249,7 @@ struct _usbd_mass_storage {
 };
 
 static usbd_mass_storage _mass_storage;
+static uint8_t _msc_buf[2][MSC_BLOCK_SIZE] __attribute__((aligned(4)));
 
 /*-- SCSI Base Responses -----------------------------------------------------*/
 
@@ -251,11 +308,209 @@ static void set_sbc_status_good(usbd_mass_storage *ms)
 		       SBC_ASCQ_NA);
 }
 
+static void scsi_fail_invalid_field(usbd_mass_storage *ms)
+{
+	ms->trans.csw.csw.bCSWStatus = CSW_STATUS_FAILED;
+	set_sbc_status(ms, SBC_SENSE_KEY_ILLEGAL_REQUEST,
+		       SBC_ASC_INVALID_FIELD_IN_CDB,
+		       SBC_ASCQ_NA);
+}
+
+/* Fail the command on the first media error, with sense data to match. */
+static void msc_media_status(usbd_mass_storage *ms, int status, bool write)
+{
+	if (USB_MSC_MEDIA_OK == status ||
+	    CSW_STATUS_SUCCESS != ms->trans.csw.csw.bCSWStatus) {
+		return;
+	}
+
+	ms->trans.csw.csw.bCSWStatus = CSW_STATUS_FAILED;
+	switch (status) {
+	case USB_MSC_MEDIA_NOT_PRESENT:
+		set_sbc_status(ms, SBC_SENSE_KEY_NOT_READY,
+			       SBC_ASC_MEDIUM_NOT_PRESENT,
+			       SBC_ASCQ_NA);
+		break;
+	case USB_MSC_MEDIA_WRITE_PROTECTED:
+		set_sbc_status(ms, SBC_SENSE_KEY_DATA_PROTECT,
+			       SBC_ASC_WRITE_PROTECTED,
+			       SBC_ASCQ_NA);
+		break;
+	case USB_MSC_MEDIA_OUT_OF_RANGE:
+		set_sbc_status(ms, SBC_SENSE_KEY_ILLEGAL_REQUEST,
+			       SBC_ASC_LBA_OUT_OF_RANGE,
+			       SBC_ASCQ_NA);
+		break;
+	default:
+		set_sbc_status(ms, SBC_SENSE_KEY_MEDIUM_ERROR,
+			       write ? SBC_ASC_PERIPHERAL_DEVICE_WRITE_FAULT :
+				       SBC_ASC_UNRECOVERED_READ_ERROR,
+			       SBC_ASCQ_NA);
+		break;
+	}
+}
+
+/* Blocking media access, several blocks at a time when the backend can. */
+static int msc_media_read(usbd_mass_storage *ms, uint32_t lba, uint8_t *buf,
+			  uint32_t count)
+{
+	uint32_t i;
+	int ret = 0;
+
+	if (ms->read_blocks) {
+		ret = (*ms->read_blocks)(lba, buf, count);
+	} else {
+		for (i = 0; !ret && i < count; i++) {
+			ret = (*ms->read_block)(lba + i,
+						buf + i * MSC_BLOCK_SIZE);
+		}
+	}
+	return ret;
+}
+
+static int msc_media_write(usbd_mass_storage *ms, uint32_t lba,
+			   const uint8_t *buf, uint32_t count)
+{
+	uint32_t i;
+	int ret = 0;
+
+	if (ms->write_blocks) {
+		ret = (*ms->write_blocks)(lba, buf, count);
+	} else {
+		for (i = 0; !ret && i < count; i++) {
+			ret = (*ms->write_block)(lba + i,
+						 buf + i * MSC_BLOCK_SIZE);
+		}
+	}
+	return ret;
+}
+
+static bool msc_cache_has(usbd_mass_storage *ms, uint32_t i)
+{
+	return ms->cache_valid[i / 32] & (1UL << (i % 32));
+}
+
+/* Write the cached erase block back, if the host changed it. */
+static int msc_cache_flush(usbd_mass_storage *ms)
+{
+	uint32_t n, i, j;
+	int status = USB_MSC_MEDIA_OK;
+
+	if (!ms->cache_dirty) {
+		return status;
+	}
+
+	/* The last erase block may be cut short by the end of the media. */
+	n = MIN(ms->cache_blocks, ms->block_count + 1 - ms->cache_lba);
+	for (i = 0; !status && i < n; i++) {
+		if (msc_cache_has(ms, i)) {
+			continue;
+		}
+		/* Read each run of missing blocks in one go. */
+		j = i + 1;
+		while (j < n && !msc_cache_has(ms, j)) {
+			j++;
+		}
+		status = msc_media_read(ms, ms->cache_lba + i,
+					ms->cache + i * MSC_BLOCK_SIZE, j - i);
+		i = j;
+	}
+	if (!status) {
+		status = msc_media_write(ms, ms->cache_lba, ms->cache, n);
+	}
+	if (!status) {
+		memset(ms->cache_valid, 0xff, sizeof(ms->cache_valid));
+		ms->cache_dirty = false;
+	}
+	return status;
+}
+
+static int msc_cache_write(usbd_mass_storage *ms, uint32_t lba,
+			   const uint8_t *buf, uint32_t count)
+{
+	uint32_t off;
+	int status;
+
+	for (; count; count--, lba++, buf += MSC_BLOCK_SIZE) {
+		if (lba > ms->block_count) {
+			return USB_MSC_MEDIA_OUT_OF_RANGE;
+		}
+
+		off = lba % ms->cache_blocks;
+		if (lba - off != ms->cache_lba) {
+			status = msc_cache_flush(ms);
+			if (status) {
+				return status;
+			}
+			ms->cache_lba = lba - off;
+			memset(ms->cache_valid, 0, sizeof(ms->cache_valid));
+		}
+
+		memcpy(ms->cache + off * MSC_BLOCK_SIZE, buf, MSC_BLOCK_SIZE);
+		ms->cache_valid[off / 32] |= 1UL << (off % 32);
+		ms->cache_dirty = true;
+	}
+
+	ms->cache_idle = 0;
+	return USB_MSC_MEDIA_OK;
+}
+
+/* Blocks read from the media may be older than the cache. */
+static void msc_cache_read(usbd_mass_storage *ms, uint32_t lba, uint8_t *buf,
+			   uint32_t count)
+{
+	uint32_t i;
+
+	if (MSC_CACHE_NONE == ms->cache_lba) {
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		uint32_t off = lba + i - ms->cache_lba;
+
+		if (lba + i >= ms->cache_lba && off < ms->cache_blocks &&
+		    msc_cache_has(ms, off)) {
+			memcpy(buf + i * MSC_BLOCK_SIZE,
+			       ms->cache + off * MSC_BLOCK_SIZE,
+			       MSC_BLOCK_SIZE);
+		}
+	}
+}
+
 static uint8_t *get_cbw_buf(struct usb_msc_trans *trans)
 {
 	return &trans->cbw.cbw.CBWCB[0];
 }
 
+/*
+ * Blocks past the end of the media fail the command before any data moves;
+ * the host is told so through sense data.
+ */
+static void scsi_check_range(usbd_mass_storage *ms,
+			     struct usb_msc_trans *trans)
+{
+	if (trans->lba_start > ms->block_count ||
+	    trans->block_count > ms->block_count + 1 - trans->lba_start) {
+		trans->block_count = 0;
+		trans->csw.csw.bCSWStatus = CSW_STATUS_FAILED;
+		set_sbc_status(ms, SBC_SENSE_KEY_ILLEGAL_REQUEST,
+			       SBC_ASC_LBA_OUT_OF_RANGE,
+			       SBC_ASCQ_NA);
+	}
+}
+
+/*
+ * Bytes in the blocks of a 12 byte command. A count past 4 GiB saturates
+ * rather than wraps to 0, the transfer is clipped to what the host expects.
+ */
+static uint32_t scsi_block_bytes(uint32_t block_count)
+{
+	if (block_count > UINT32_MAX / MSC_BLOCK_SIZE) {
+		return UINT32_MAX;
+	}
+	return block_count * MSC_BLOCK_SIZE;
+}
+
 static void scsi_read_6(usbd_mass_storage *ms,
 			struct usb_msc_trans *trans,
 			enum trans_event event)
@@ -265,16 +520,17 @@ static void scsi_read_6(usbd_mass_storage *ms,
 
 		buf = get_cbw_buf(trans);
 
-		trans->lba_start = (buf[2] << 8) | buf[3];
-		trans->block_count = buf[4];
+		trans->lba_start = ((0x1f & buf[1]) << 16)
+				    | (buf[2] << 8) | buf[3];
+		/* A transfer length of 0 means 256 blocks here. */
+		trans->block_count = buf[4] ? buf[4] : 256;
 		trans->current_block = 0;
 
-		/* TODO: Check the lba & block_count for range. */
+		set_sbc_status_good(ms);
+		scsi_check_range(ms, trans);
 
 		/* both are in terms of 512 byte blocks, so shift by 9 */
 		trans->bytes_to_write = trans->block_count << 9;
-
-		set_sbc_status_good(ms);
 	}
 }
 
@@ -282,8 +538,6 @@ static void scsi_write_6(usbd_mass_storage *ms,
 			 struct usb_msc_trans *trans,
 			 enum trans_event event)
 {
-	(void) ms;
-
 	if (EVENT_CBW_VALID == event) {
 		uint8_t *buf;
 
@@ -291,9 +545,12 @@ static void scsi_write_6(usbd_mass_storage *ms,
 
 		trans->lba_start = ((0x1f & buf[1]) << 16)
 				    | (buf[2] << 8) | buf[3];
-		trans->block_count = buf[4];
+		trans->block_count = buf[4] ? buf[4] : 256;
 		trans->current_block = 0;
 
+		set_sbc_status_good(ms);
+		scsi_check_range(ms, trans);
+
 		trans->bytes_to_read = trans->block_count << 9;
 	}
 }
@@ -302,8 +559,6 @@ static void scsi_write_10(usbd_mass_storage *ms,
 			  struct usb_msc_trans *trans,
 			  enum trans_event event)
 {
-	(void) ms;
-
 	if (EVENT_CBW_VALID == event) {
 		uint8_t *buf;
 
@@ -314,6 +569,9 @@ static void scsi_write_10(usbd_mass_storage *ms,
 		trans->block_count = (buf[7] << 8) | buf[8];
 		trans->current_block = 0;
 
+		set_sbc_status_good(ms);
+		scsi_check_range(ms, trans);
+
 		trans->bytes_to_read = trans->block_count << 9;
 	}
 }
@@ -330,13 +588,86 @@ static void scsi_read_10(usbd_mass_storage *ms,
 		trans->lba_start = (buf[2] << 24) | (buf[3] << 16)
 				   | (buf[4] << 8) | buf[5];
 		trans->block_count = (buf[7] << 8) | buf[8];
+		trans->current_block = 0;
 
-		/* TODO: Check the lba & block_count for range. */
+		set_sbc_status_good(ms);
+		scsi_check_range(ms, trans);
 
 		/* both are in terms of 512 byte blocks, so shift by 9 */
 		trans->bytes_to_write = trans->block_count << 9;
+	}
+}
+
+static void scsi_write_12(usbd_mass_storage *ms,
+			  struct usb_msc_trans *trans,
+			  enum trans_event event)
+{
+	if (EVENT_CBW_VALID == event) {
+		uint8_t *buf;
+
+		buf = get_cbw_buf(trans);
+
+		trans->lba_start = (buf[2] << 24) | (buf[3] << 16) |
+					(buf[4] << 8) | buf[5];
+		trans->block_count = (buf[6] << 24) | (buf[7] << 16) |
+					(buf[8] << 8) | buf[9];
+		trans->current_block = 0;
 
 		set_sbc_status_good(ms);
+		scsi_check_range(ms, trans);
+
+		trans->bytes_to_read = scsi_block_bytes(trans->block_count);
+	}
+}
+
+static void scsi_read_12(usbd_mass_storage *ms,
+			 struct usb_msc_trans *trans,
+			 enum trans_event event)
+{
+	if (EVENT_CBW_VALID == event) {
+		uint8_t *buf;
+
+		buf = get_cbw_buf(trans);
+
+		trans->lba_start = (buf[2] << 24) | (buf[3] << 16)
+				   | (buf[4] << 8) | buf[5];
+		trans->block_count = (buf[6] << 24) | (buf[7] << 16)
+				     | (buf[8] << 8) | buf[9];
+		trans->current_block = 0;
+
+		set_sbc_status_good(ms);
+		scsi_check_range(ms, trans);
+
+		trans->bytes_to_write = scsi_block_bytes(trans->block_count);
+	}
+}
+
+/*
+ * Blocks are not checked against the media, so only the range is verified.
+ * Comparing against data from the host (BYTCHK) is not supported.
+ */
+static void scsi_verify(usbd_mass_storage *ms,
+			struct usb_msc_trans *trans,
+			enum trans_event event)
+{
+	if (EVENT_CBW_VALID == event) {
+		uint8_t *buf;
+
+		buf = get_cbw_buf(trans);
+
+		set_sbc_status_good(ms);
+		if (buf[1] & 0x02) {
+			scsi_fail_invalid_field(ms);
+			return;
+		}
+
+		trans->lba_start = (buf[2] << 24) | (buf[3] << 16)
+				   | (buf[4] << 8) | buf[5];
+		trans->block_count = (buf[7] << 8) | buf[8];
+		scsi_check_range(ms, trans);
+
+		/* No data phase. */
+		trans->block_count = 0;
 	}
 }
 
@@ -366,14 +697,41 @@ static void scsi_format_unit(usbd_mass_storage *ms,
 {
 	if (EVENT_CBW_VALID == event) {
 		uint32_t i;
+		int status = USB_MSC_MEDIA_OK;
+
+		/* An asynchronous backend can't be blocked on here. */
+		if (!ms->write_blocks && !ms->write_block) {
+			set_sbc_status(ms, SBC_SENSE_KEY_ILLEGAL_REQUEST,
+				       SBC_ASC_INVALID_COMMAND_OPERATION_CODE,
+				       SBC_ASCQ_NA);
+			trans->csw.csw.bCSWStatus = CSW_STATUS_FAILED;
+			return;
+		}
 
-		memset(trans->msd_buf, 0, 512);
+		memset(trans->msd_buf, 0, MSC_BLOCK_SIZE);
 
-		for (i = 0; i < ms->block_count; i++) {
-			(*ms->write_block)(i, trans->msd_buf);
+		set_sbc_status_good(ms);
+		/* Whatever is cached is about to be wiped anyway. */
+		ms->cache_lba = MSC_CACHE_NONE;
+		ms->cache_dirty = false;
+		/* block_count is the last LBA. */
+		for (i = 0; !status && i <= ms->block_count; i++) {
+			status = msc_media_write(ms, i, trans->msd_buf, 1);
 		}
+		msc_media_status(ms, status, true);
+	}
+}
+
+/* Also used for START STOP UNIT: the host may power the media off next. */
+static void scsi_synchronize_cache(usbd_mass_storage *ms,
+				   struct usb_msc_trans *trans,
+				   enum trans_event event)
+{
+	(void) trans;
 
+	if (EVENT_CBW_VALID == event) {
 		set_sbc_status_good(ms);
+		msc_media_status(ms, msc_cache_flush(ms), true);
 	}
 }
 
@@ -386,7 +744,8 @@ static void scsi_request_sense(usbd_mass_storage *ms,
 
 		buf = &trans->cbw.cbw.CBWCB[0];
 
-		trans->bytes_to_write = buf[4];	/* allocation length */
+		trans->bytes_to_write = MIN(sizeof(_spc3_request_sense),
+					    buf[4]);	/* allocation length */
 		memcpy(trans->msd_buf, _spc3_request_sense,
 		       sizeof(_spc3_request_sense));
 
@@ -396,42 +755,105 @@ static void scsi_request_sense(usbd_mass_storage *ms,
 	}
 }
 
+/*
+ * Mode pages after the mode parameter header, see (SPC-3) 7.4.
+ * The caching page reports the write cache so the host flushes it with
+ * SYNCHRONIZE CACHE. Nothing is changeable.
+ */
+static int scsi_mode_pages(usbd_mass_storage *ms, uint8_t *cdb, uint8_t *buf)
+{
+	uint8_t page = cdb[2] & 0x3f;
+	bool changeable = (cdb[2] & 0xc0) == 0x40;
+	int len = 0;
+
+	if (0x08 == page || 0x3f == page) {	/* Caching */
+		memset(&buf[len], 0, 20);
+		buf[len] = 0x08;
+		buf[len + 1] = 18;
+		if (ms->cache && !changeable) {
+			buf[len + 2] = 0x04;	/* WCE */
+		}
+		len += 20;
+	}
+	if (0x1c == page || 0x3f == page) {	/* Informational Exceptions */
+		memset(&buf[len], 0, 12);
+		buf[len] = 0x1c;
+		buf[len + 1] = 10;
+		len += 12;
+	}
+
+	if (!len) {
+		scsi_fail_invalid_field(ms);
+		return -1;
+	}
+	return len;
+}
+
 static void scsi_mode_sense_6(usbd_mass_storage *ms,
 			      struct usb_msc_trans *trans,
 			      enum trans_event event)
 {
-	(void) ms;
+	if (EVENT_CBW_VALID == event) {
+		uint8_t *buf;
+		int len;
 
+		buf = get_cbw_buf(trans);
+		len = scsi_mode_pages(ms, buf, &trans->msd_buf[4]);
+		if (len < 0) {
+			return;
+		}
+
+		trans->msd_buf[0] = 3 + len;	/* Num bytes that follow */
+		trans->msd_buf[1] = 0;	/* Medium Type */
+		trans->msd_buf[2] = 0;	/* Device specific param */
+		trans->msd_buf[3] = 0;	/* Block descriptor length */
+		trans->bytes_to_write = MIN(4 + len, buf[4]);
+		set_sbc_status_good(ms);
+	}
+}
+
+static void scsi_mode_sense_10(usbd_mass_storage *ms,
+			       struct usb_msc_trans *trans,
+			       enum trans_event event)
+{
 	if (EVENT_CBW_VALID == event) {
-#if 0
 		uint8_t *buf;
-		uint8_t page_code;
-		uint8_t allocation_length;
+		int len;
 
-		buf = &trans->cbw.cbw.CBWCB[0];
-		page_code = buf[2];
-		allocation_length = buf[4];
-
-		if (0x1C == page_code) {	/* Informational Exceptions */
-#endif
-			trans->bytes_to_write = 4;
-
-			trans->msd_buf[0] = 3;	/* Num bytes that follow */
-			trans->msd_buf[1] = 0;	/* Medium Type */
-			trans->msd_buf[2] = 0;	/* Device specific param */
-			trans->csw.csw.dCSWDataResidue = 4;
-#if 0
-		} else if (0x01 == page_code) {	/* Error recovery */
-		} else if (0x3F == page_code) {	/* All */
-		} else {
-			/* Error */
-			trans->csw.csw.bCSWStatus = CSW_STATUS_FAILED;
-			set_sbc_status(ms,
-				       SBC_SENSE_KEY_ILLEGAL_REQUEST,
-				       SBC_ASC_INVALID_FIELD_IN_CDB,
-				       SBC_ASCQ_NA);
+		buf = get_cbw_buf(trans);
+		len = scsi_mode_pages(ms, buf, &trans->msd_buf[8]);
+		if (len < 0) {
+			return;
 		}
-#endif
+
+		memset(trans->msd_buf, 0, 8);
+		trans->msd_buf[1] = 6 + len;	/* Num bytes that follow */
+		trans->bytes_to_write = MIN(8 + len, (buf[7] << 8) | buf[8]);
+		set_sbc_status_good(ms);
+	}
+}
+
+/* (UFI) 4.10, one formatted media descriptor. */
+static void scsi_read_format_capacities(usbd_mass_storage *ms,
+					struct usb_msc_trans *trans,
+					enum trans_event event)
+{
+	if (EVENT_CBW_VALID == event) {
+		uint8_t *buf;
+		uint32_t blocks = ms->block_count + 1;
+
+		buf = get_cbw_buf(trans);
+
+		memset(trans->msd_buf, 0, 12);
+		trans->msd_buf[3] = 8;	/* Capacity list length */
+		trans->msd_buf[4] = blocks >> 24;
+		trans->msd_buf[5] = 0xff & (blocks >> 16);
+		trans->msd_buf[6] = 0xff & (blocks >> 8);
+		trans->msd_buf[7] = 0xff & blocks;
+		trans->msd_buf[8] = 0x02;	/* Formatted media */
+		trans->msd_buf[10] = 2;	/* Block size: 512 */
+		trans->bytes_to_write = MIN(12, (buf[7] << 8) | buf[8]);
+		set_sbc_status_good(ms);
 	}
 }
 
@@ -447,8 +869,10 @@ static void scsi_inquiry(usbd_mass_storage *ms,
 		evpd = 1 & buf[1];
 
 		if (0 == evpd) {
-			size_t len;
-			trans->bytes_to_write = sizeof(_spc3_inquiry_response);
+			size_t len = (buf[3] << 8) | buf[4];
+
+			trans->bytes_to_write = MIN(
+					sizeof(_spc3_inquiry_response), len);
 			memcpy(trans->msd_buf, _spc3_inquiry_response,
 			       sizeof(_spc3_inquiry_response));
 
@@ -465,13 +889,11 @@ static void scsi_inquiry(usbd_mass_storage *ms,
 			memcpy(&trans->msd_buf[32], ms->product_revision_level,
 			       len);
 
-			trans->csw.csw.dCSWDataResidue =
-				sizeof(_spc3_inquiry_response);
-
 			set_sbc_status_good(ms);
 		} else {
 			/* TODO: Add VPD 0x83 support */
 			/* TODO: Add VPD 0x00 support */
+			scsi_fail_invalid_field(ms);
 		}
 	}
 }
@@ -482,7 +904,6 @@ static void scsi_command(usbd_mass_storage *ms,
 {
 	if (EVENT_CBW_VALID == event) {
 		/* Setup the default success */
-		trans->csw_sent = 0;
 		trans->csw.csw.dCSWSignature = CSW_SIGNATURE;
 		trans->csw.csw.dCSWTag = trans->cbw.cbw.dCBWTag;
 		trans->csw.csw.dCSWDataResidue = 0;
@@ -508,6 +929,12 @@ static void scsi_command(usbd_mass_storage *ms,
 	case SCSI_MODE_SENSE_6:
 		scsi_mode_sense_6(ms, trans, event);
 		break;
+	case SCSI_MODE_SENSE_10:
+		scsi_mode_sense_10(ms, trans, event);
+		break;
+	case SCSI_READ_FORMAT_CAPACITIES:
+		scsi_read_format_capacities(ms, trans, event);
+		break;
 	case SCSI_READ_6:
 		scsi_read_6(ms, trans, event);
 		break;
@@ -526,6 +953,19 @@ static void scsi_command(usbd_mass_storage *ms,
 	case SCSI_WRITE_10:
 		scsi_write_10(ms, trans, event);
 		break;
+	case SCSI_READ_12:
+		scsi_read_12(ms, trans, event);
+		break;
+	case SCSI_WRITE_12:
+		scsi_write_12(ms, trans, event);
+		break;
+	case SCSI_VERIFY:
+		scsi_verify(ms, trans, event);
+		break;
+	case SCSI_SYNCHRONIZE_CACHE:
+	case SCSI_START_STOP_UNIT:
+		scsi_synchronize_cache(ms, trans, event);
+		break;
 	default:
 		set_sbc_status(ms, SBC_SENSE_KEY_ILLEGAL_REQUEST,
 					SBC_ASC_INVALID_COMMAND_OPERATION_CODE,
@@ -540,196 +980,419 @@ static void scsi_command(usbd_mass_storage *ms,
 
 /*-- USB Mass Storage Layer --------------------------------------------------*/
 
-/** @brief Handle the USB 'OUT' requests. */
-static void msc_data_rx_cb(usbd_device *usbd_dev, uint8_t ep)
-{
-	usbd_mass_storage *ms;
-	struct usb_msc_trans *trans;
-	int len, max_len, left;
-	void *p;
-
-	ms = &_mass_storage;
-	trans = &ms->trans;
-
-	/* RX only */
-	left = sizeof(struct usb_msc_cbw) - trans->cbw_cnt;
-	if (0 < left) {
-		max_len = MIN(ms->ep_out_size, left);
-		p = &trans->cbw.buf[0x1ff & trans->cbw_cnt];
-		len = usbd_ep_read_packet(usbd_dev, ep, p, max_len);
-		trans->cbw_cnt += len;
-
-		if (sizeof(struct usb_msc_cbw) == trans->cbw_cnt) {
-			scsi_command(ms, trans, EVENT_CBW_VALID);
-			if (trans->byte_count < trans->bytes_to_read) {
-				/* We must wait until there is something to
-				 * read again. */
-				return;
-			}
-		}
+static void msc_receive_cbw(usbd_mass_storage *ms);
+
+static void msc_reset_trans(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+
+	if (MSC_PIPE_IDLE != trans->pipe && NULL != ms->unlock) {
+		(*ms->unlock)();
+	}
+	if (ms->media_busy) {
+		ms->media_stale = true;
 	}
 
-	if (trans->byte_count < trans->bytes_to_read) {
-		if (0 < trans->block_count) {
-			if ((0 == trans->byte_count) && (NULL != ms->lock)) {
-				(*ms->lock)();
-			}
-		}
+	trans->lba_start = 0xffffffff;
+	trans->block_count = 0;
+	trans->current_block = 0;
+	trans->bytes_to_read = 0;
+	trans->bytes_to_write = 0;
+	trans->byte_count = 0;
+	trans->buf_fill[0] = 0;
+	trans->buf_fill[1] = 0;
+	trans->usb_buf = 0;
+	trans->usb_busy = false;
+	trans->pipe = MSC_PIPE_IDLE;
+	trans->data_short = false;
+	trans->drained = 0;
+}
 
-		left = trans->bytes_to_read - trans->byte_count;
-		max_len = MIN(ms->ep_out_size, left);
-		p = &trans->msd_buf[0x1ff & trans->byte_count];
-		len = usbd_ep_read_packet(usbd_dev, ep, p, max_len);
-		trans->byte_count += len;
-
-		if (0 < trans->block_count) {
-			if (0 == (0x1ff & trans->byte_count)) {
-				uint32_t lba;
-
-				lba = trans->lba_start + trans->current_block;
-				if (0 != (*ms->write_block)(lba,
-							    trans->msd_buf)) {
-					/* Error */
-				}
-				trans->current_block++;
-			}
-		}
+/*
+ * Wait for the next CBW. A stale media operation may still use the buffers
+ * the next command answers from, the CBW then waits for it to finish, see
+ * usb_msc_media_done().
+ */
+static void msc_restart(usbd_mass_storage *ms)
+{
+	msc_reset_trans(ms);
+	if (!ms->media_busy) {
+		msc_receive_cbw(ms);
+	}
+}
+
+static void msc_csw_sent(usbd_device *usbd_dev, uint8_t ep, uint32_t len)
+{
+	usbd_mass_storage *ms = &_mass_storage;
+
+	(void)usbd_dev;
+	(void)ep;
+	(void)len;
+
+	/* End of transaction */
+	msc_restart(ms);
+}
+
+static void msc_send_csw(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+	uint32_t expected = trans->cbw.cbw.dCBWDataTransferLength;
+
+	scsi_command(ms, trans, EVENT_NEED_STATUS);
+	if (trans->byte_count < expected) {
+		trans->csw.csw.dCSWDataResidue = expected - trans->byte_count;
+	}
+
+	usbd_ep_transfer(ms->usbd_dev, ms->ep_in, trans->csw.buf,
+			 sizeof(struct usb_msc_csw), false, msc_csw_sent);
+}
+
+static void msc_drained(usbd_device *usbd_dev, uint8_t ep, uint32_t len);
+
+/*
+ * The host always gets the data phase it asked for, (A) 6.7: an IN phase
+ * the command left short on a packet boundary ends with a zero length
+ * packet, OUT data the command did not want is received and dropped. The
+ * residue counts what the command did not move.
+ */
+static void msc_end_data(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+	uint32_t expected = trans->cbw.cbw.dCBWDataTransferLength;
+	uint32_t done = trans->byte_count + trans->drained;
+
+	if (done >= expected || trans->data_short) {
+		msc_send_csw(ms);
+	} else if (trans->cbw.cbw.bmCBWFlags & 0x80) {
+		trans->data_short = true;
+		usbd_ep_transfer(ms->usbd_dev, ms->ep_in, NULL, 0, false,
+				 msc_drained);
+	} else {
+		trans->usb_len = MIN(expected - done,
+				     ms->buf_blocks * MSC_BLOCK_SIZE);
+		usbd_ep_transfer(ms->usbd_dev, ms->ep_out, trans->msd_buf,
+				 trans->usb_len, false, msc_drained);
+	}
+}
+
+static void msc_drained(usbd_device *usbd_dev, uint8_t ep, uint32_t len)
+{
+	usbd_mass_storage *ms = &_mass_storage;
+	struct usb_msc_trans *trans = &ms->trans;
+
+	(void)usbd_dev;
+
+	if (!(ep & 0x80)) {
+		trans->drained += len;
+		trans->data_short = len != trans->usb_len;
+	}
+	msc_end_data(ms);
+}
+
+static void msc_data_done(usbd_device *usbd_dev, uint8_t ep, uint32_t len)
+{
+	usbd_mass_storage *ms = &_mass_storage;
+	struct usb_msc_trans *trans = &ms->trans;
+
+	(void)usbd_dev;
+
+	trans->byte_count += len;
+	if (!(ep & 0x80) && len != trans->usb_len) {
+		trans->data_short = true;
+	}
+	msc_end_data(ms);
+}
+
+/* All blocks of the command moved. */
+static void msc_pipe_done(usbd_mass_storage *ms)
+{
+	ms->trans.pipe = MSC_PIPE_IDLE;
+	if (NULL != ms->unlock) {
+		(*ms->unlock)();
+	}
+	msc_end_data(ms);
+}
 
-		/* Fix "writes aren't acknowledged" bug on Linux (PR #409) */
-		if (false == trans->csw_valid) {
-			scsi_command(ms, trans, EVENT_NEED_STATUS);
-			trans->csw_valid = true;
+/*
+ * Media operations. A blocking backend is done before msc_media_start()
+ * returns, an asynchronous one calls usb_msc_media_done() later.
+ */
+static void msc_media_finish(usbd_mass_storage *ms, int status)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+	bool write = MSC_PIPE_WRITE == trans->pipe;
+
+	ms->media_busy = false;
+	if (ms->media_stale) {
+		ms->media_stale = false;
+		return;
+	}
+
+	msc_media_status(ms, status, write);
+	if (USB_MSC_MEDIA_OK != status) {
+		/*
+		 * The first failure ends the media side of the command. Blocks
+		 * already read still go out, the failed ones and any after
+		 * them are left to msc_end_data() and count in the residue.
+		 */
+		trans->block_count = trans->current_block;
+		return;
+	}
+	if (!write && ms->cache) {
+		msc_cache_read(ms, trans->lba_start + trans->current_block,
+			       ms->buf[ms->media_buf], ms->media_count);
+	}
+	trans->current_block += ms->media_count;
+	trans->buf_fill[ms->media_buf] = write ? 0 : ms->media_count;
+}
+
+static void msc_media_start(usbd_mass_storage *ms, int i, uint32_t count)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+	uint32_t lba = trans->lba_start + trans->current_block;
+	int status;
+
+	ms->media_busy = true;
+	ms->media_buf = i;
+	ms->media_count = count;
+
+	if (MSC_PIPE_WRITE == trans->pipe) {
+		if (ms->cache) {
+			status = msc_cache_write(ms, lba, ms->buf[i], count);
+		} else if (ms->start_write) {
+			(*ms->start_write)(lba, ms->buf[i], count);
+			return;
+		} else {
+			status = msc_media_write(ms, lba, ms->buf[i], count);
 		}
-		left = sizeof(struct usb_msc_csw) - trans->csw_sent;
-		if (0 < left) {
-			max_len = MIN(ms->ep_out_size, left);
-			p = &trans->csw.buf[trans->csw_sent];
-			len = usbd_ep_write_packet(usbd_dev, ms->ep_in, p,
-						   max_len);
-			trans->csw_sent += len;
+	} else {
+		if (ms->start_read) {
+			(*ms->start_read)(lba, ms->buf[i], count);
+			return;
 		}
+		status = msc_media_read(ms, lba, ms->buf[i], count);
+	}
+	msc_media_finish(ms, status);
+}
 
-	} else if (trans->byte_count < trans->bytes_to_write) {
-		if (0 < trans->block_count) {
-			if ((0 == trans->byte_count) && (NULL != ms->lock)) {
-				(*ms->lock)();
-			}
+/* A buffer the media is not busy with, stale operations included. */
+static bool msc_buf_free(usbd_mass_storage *ms, int i)
+{
+	return !ms->trans.buf_fill[i] &&
+	       !(ms->media_busy && ms->media_buf == i);
+}
 
-			if (0 == (0x1ff & trans->byte_count)) {
-				uint32_t lba;
+static void msc_read_sent(usbd_device *usbd_dev, uint8_t ep, uint32_t len);
 
-				lba = trans->lba_start + trans->current_block;
-				if (0 != (*ms->read_block)(lba,
-							   trans->msd_buf)) {
-					/* Error */
-				}
-				trans->current_block++;
-			}
+/*
+ * Drive a read: send the buffer that is due once it is filled, read ahead
+ * into the other one meanwhile. While neither is ready the IN endpoint has
+ * nothing queued and NAKs.
+ */
+static void msc_read_pump(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+	int i = trans->usb_buf;
+	uint32_t count;
+
+	if (MSC_PIPE_READ != trans->pipe) {
+		return;
+	}
+
+	if (!trans->usb_busy && trans->buf_fill[i]) {
+		trans->usb_busy = true;
+		usbd_ep_transfer(ms->usbd_dev, ms->ep_in, ms->buf[i],
+				 trans->buf_fill[i] * MSC_BLOCK_SIZE, false,
+				 msc_read_sent);
+	}
+
+	if (trans->usb_busy) {
+		i ^= 1;
+	}
+	count = MIN(ms->buf_blocks, trans->block_count - trans->current_block);
+	if (count && !ms->media_busy && msc_buf_free(ms, i)) {
+		msc_media_start(ms, i, count);
+		if (!ms->media_busy) {
+			msc_read_pump(ms);
 		}
+		return;
+	}
 
-		left = trans->bytes_to_write - trans->byte_count;
-		max_len = MIN(ms->ep_out_size, left);
-		p = &trans->msd_buf[0x1ff & trans->byte_count];
-		len = usbd_ep_write_packet(usbd_dev, ms->ep_in, p, max_len);
-		trans->byte_count += len;
-	} else {
-		if (0 < trans->block_count) {
-			if (trans->current_block == trans->block_count) {
-				uint32_t lba;
-
-				lba = trans->lba_start + trans->current_block;
-				if (0 != (*ms->write_block)(lba,
-							    trans->msd_buf)) {
-					/* Error */
-				}
-
-				trans->current_block = 0;
-				if (NULL != ms->unlock) {
-					(*ms->unlock)();
-				}
-			}
+	if (!count && !trans->usb_busy && !ms->media_busy) {
+		msc_pipe_done(ms);
+	}
+}
+
+static void msc_read_sent(usbd_device *usbd_dev, uint8_t ep, uint32_t len)
+{
+	usbd_mass_storage *ms = &_mass_storage;
+	struct usb_msc_trans *trans = &ms->trans;
+
+	(void)usbd_dev;
+	(void)ep;
+
+	trans->byte_count += len;
+	trans->buf_fill[trans->usb_buf] = 0;
+	trans->usb_buf ^= 1;
+	trans->usb_busy = false;
+	msc_read_pump(ms);
+}
+
+static void msc_write_received(usbd_device *usbd_dev, uint8_t ep,
+			       uint32_t len);
+
+/*
+ * Drive a write: let the host fill a free buffer while the media writes
+ * the other one. With both buffers full no OUT transfer is queued and the
+ * endpoint NAKs until the media catches up.
+ */
+static void msc_write_pump(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+	uint32_t count;
+	int i;
+
+	if (MSC_PIPE_WRITE != trans->pipe) {
+		return;
+	}
+
+	if (trans->current_block == trans->block_count) {
+		/* After a media failure received blocks are dropped. */
+		count = 0;
+		for (i = 0; i < 2; i++) {
+			trans->byte_count -= trans->buf_fill[i] *
+					     MSC_BLOCK_SIZE;
+			trans->drained += trans->buf_fill[i] * MSC_BLOCK_SIZE;
+			trans->buf_fill[i] = 0;
 		}
-		if (false == trans->csw_valid) {
-			scsi_command(ms, trans, EVENT_NEED_STATUS);
-			trans->csw_valid = true;
+	} else {
+		count = MIN(ms->buf_blocks,
+			    (trans->bytes_to_read - trans->byte_count) /
+			    MSC_BLOCK_SIZE);
+	}
+	for (i = 0; count && !trans->usb_busy && i < 2; i++) {
+		if (msc_buf_free(ms, i)) {
+			trans->usb_busy = true;
+			trans->usb_buf = i;
+			trans->usb_len = count * MSC_BLOCK_SIZE;
+			usbd_ep_transfer(ms->usbd_dev, ms->ep_out, ms->buf[i],
+					 trans->usb_len, false,
+					 msc_write_received);
 		}
+	}
 
-		left = sizeof(struct usb_msc_csw) - trans->csw_sent;
-		if (0 < left) {
-			max_len = MIN(ms->ep_out_size, left);
-			p = &trans->csw.buf[trans->csw_sent];
-			len = usbd_ep_write_packet(usbd_dev, ms->ep_in, p,
-						   max_len);
-			trans->csw_sent += len;
+	/*
+	 * With the media idle at most one buffer is full, so blocks go out
+	 * in the order they came in.
+	 */
+	i = trans->buf_fill[0] ? 0 : 1;
+	if (!ms->media_busy && trans->buf_fill[i]) {
+		msc_media_start(ms, i, trans->buf_fill[i]);
+		if (!ms->media_busy) {
+			msc_write_pump(ms);
 		}
+		return;
+	}
+
+	if (!count && !trans->usb_busy && !ms->media_busy &&
+	    !trans->buf_fill[0] && !trans->buf_fill[1]) {
+		msc_pipe_done(ms);
 	}
 }
 
-/** @brief Handle the USB 'IN' requests. */
-static void msc_data_tx_cb(usbd_device *usbd_dev, uint8_t ep)
+static void msc_write_received(usbd_device *usbd_dev, uint8_t ep,
+			       uint32_t len)
 {
-	usbd_mass_storage *ms;
-	struct usb_msc_trans *trans;
-	int len, max_len, left;
-	void *p;
+	usbd_mass_storage *ms = &_mass_storage;
+	struct usb_msc_trans *trans = &ms->trans;
 
-	ms = &_mass_storage;
-	trans = &ms->trans;
+	(void)usbd_dev;
+	(void)ep;
 
-	if (trans->byte_count < trans->bytes_to_write) {
-		if (0 < trans->block_count) {
-			if (0 == (0x1ff & trans->byte_count)) {
-				uint32_t lba;
+	trans->byte_count += len;
+	if (len != trans->usb_len) {
+		/* The host ended the data phase early. */
+		trans->bytes_to_read = trans->byte_count;
+		trans->data_short = true;
+	}
+	trans->buf_fill[trans->usb_buf] = len / MSC_BLOCK_SIZE;
+	trans->usb_busy = false;
+	msc_write_pump(ms);
+}
 
-				lba = trans->lba_start + trans->current_block;
-				if (0 != (*ms->read_block)(lba,
-							   trans->msd_buf)) {
-					/* Error */
-				}
-				trans->current_block++;
-			}
-		}
+static void msc_cbw_received(usbd_device *usbd_dev, uint8_t ep, uint32_t len)
+{
+	usbd_mass_storage *ms = &_mass_storage;
+	struct usb_msc_trans *trans = &ms->trans;
+	uint32_t expected;
+	bool in;
 
-		left = trans->bytes_to_write - trans->byte_count;
-		max_len = MIN(ms->ep_out_size, left);
-		p = &trans->msd_buf[0x1ff & trans->byte_count];
-		len = usbd_ep_write_packet(usbd_dev, ep, p, max_len);
-		trans->byte_count += len;
-	} else {
-		if (0 < trans->block_count) {
-			if (trans->current_block == trans->block_count) {
-				trans->current_block = 0;
-				if (NULL != ms->unlock) {
-					(*ms->unlock)();
-				}
+	(void)ep;
+
+	if ((sizeof(struct usb_msc_cbw) != len) ||
+	    (CBW_SIGNATURE != trans->cbw.cbw.dCBWSignature)) {
+		/* Not a CBW, wait for the next one. */
+		msc_receive_cbw(ms);
+		return;
+	}
+
+	scsi_command(ms, trans, EVENT_CBW_VALID);
+	expected = trans->cbw.cbw.dCBWDataTransferLength;
+	in = trans->cbw.cbw.bmCBWFlags & 0x80;
+
+	/* Data the host does not expect, or in the other direction. */
+	if ((trans->bytes_to_write && (!expected || !in)) ||
+	    (trans->bytes_to_read && (!expected || in))) {
+		trans->csw.csw.bCSWStatus = CSW_STATUS_PHASE_ERROR;
+		msc_end_data(ms);
+		return;
+	}
+
+	if (0 < trans->block_count) {
+		/* Move no more than the host asked for. */
+		if (trans->block_count > expected / MSC_BLOCK_SIZE) {
+			trans->csw.csw.bCSWStatus = CSW_STATUS_PHASE_ERROR;
+			trans->block_count = expected / MSC_BLOCK_SIZE;
+			if (!trans->block_count) {
+				msc_end_data(ms);
+				return;
 			}
 		}
-		if (false == trans->csw_valid) {
-			scsi_command(ms, trans, EVENT_NEED_STATUS);
-			trans->csw_valid = true;
-		}
 
-		left = sizeof(struct usb_msc_csw) - trans->csw_sent;
-		if (0 < left) {
-			max_len = MIN(ms->ep_out_size, left);
-			p = &trans->csw.buf[trans->csw_sent];
-			len = usbd_ep_write_packet(usbd_dev, ep, p, max_len);
-			trans->csw_sent += len;
-		} else if (sizeof(struct usb_msc_csw) == trans->csw_sent) {
-			/* End of transaction */
-			trans->lba_start = 0xffffffff;
-			trans->block_count = 0;
-			trans->current_block = 0;
-			trans->cbw_cnt = 0;
-			trans->bytes_to_read = 0;
-			trans->bytes_to_write = 0;
-			trans->byte_count = 0;
-			trans->csw_sent = 0;
-			trans->csw_valid = false;
+		if (NULL != ms->lock) {
+			(*ms->lock)();
 		}
+		if (in) {
+			trans->pipe = MSC_PIPE_READ;
+			msc_read_pump(ms);
+		} else {
+			trans->bytes_to_read = trans->block_count * MSC_BLOCK_SIZE;
+			trans->pipe = MSC_PIPE_WRITE;
+			msc_write_pump(ms);
+		}
+	} else if (trans->bytes_to_write) {
+		uint32_t n = MIN(trans->bytes_to_write, expected);
+
+		/* A short answer ends the data phase early. */
+		trans->data_short = n < expected;
+		usbd_ep_transfer(usbd_dev, ms->ep_in, trans->msd_buf,
+				 n, n < expected, msc_data_done);
+	} else if (trans->bytes_to_read) {
+		trans->usb_len = MIN(MIN(trans->bytes_to_read, expected),
+				     ms->buf_blocks * MSC_BLOCK_SIZE);
+		usbd_ep_transfer(usbd_dev, ms->ep_out, trans->msd_buf,
+				 trans->usb_len, false, msc_data_done);
+	} else {
+		msc_end_data(ms);
 	}
 }
 
+static void msc_receive_cbw(usbd_mass_storage *ms)
+{
+	usbd_ep_transfer(ms->usbd_dev, ms->ep_out, ms->trans.cbw.buf,
+			 sizeof(struct usb_msc_cbw), false, msc_cbw_received);
+}
+
 /** @brief Handle various control requests related to the msc storage
  *	   interface.
  */
@@ -738,12 +1401,16 @@ msc_control_request(usbd_device *usbd_dev,
 		    struct usb_setup_data *req, uint8_t **buf, uint16_t *len,
 		    usbd_control_complete_callback *complete)
 {
+	usbd_mass_storage *ms = &_mass_storage;
+
 	(void)complete;
-	(void)usbd_dev;
 
 	switch (req->bRequest) {
 	case USB_MSC_REQ_BULK_ONLY_RESET:
-		/* Do any special reset code here. */
+		/* Drop the command in progress and wait for a new CBW. */
+		usbd_ep_transfer_cancel(usbd_dev, ms->ep_in);
+		usbd_ep_transfer_cancel(usbd_dev, ms->ep_out);
+		msc_restart(ms);
 		return USBD_REQ_HANDLED;
 	case USB_MSC_REQ_GET_MAX_LUN:
 		/* Return the number of LUNs.  We use 0. */
@@ -763,15 +1430,17 @@ static void msc_set_config(usbd_device *usbd_dev, uint16_t wValue)
 	(void)wValue;
 
 	usbd_ep_setup(usbd_dev, ms->ep_in, USB_ENDPOINT_ATTR_BULK,
-		      ms->ep_in_size, msc_data_tx_cb);
+		      ms->ep_in_size, NULL);
 	usbd_ep_setup(usbd_dev, ms->ep_out, USB_ENDPOINT_ATTR_BULK,
-		      ms->ep_out_size, msc_data_rx_cb);
+		      ms->ep_out_size, NULL);
 
 	usbd_register_control_callback(
 				usbd_dev,
 				USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE,
 				USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
 				msc_control_request);
+
+	msc_restart(ms);
 }
 
 /** @addtogroup usb_msc */
@@ -792,9 +1461,15 @@ static void msc_set_config(usbd_device *usbd_dev, uint16_t wValue)
 		Maximum used length is 4.
 @param[in] block_count The number of 512-byte blocks available.
 @param[in] read_block The function called when the host requests to read a LBA
-		block.  Must _NOT_ be NULL.
+		block.  Must _NOT_ be NULL, unless blocks are read through
+		@ref usb_msc_set_block_callbacks or
+		@ref usb_msc_set_async_callbacks.
 @param[in] write_block The function called when the host requests to write a
-		LBA block.  Must _NOT_ be NULL.
+		LBA block.  Must _NOT_ be NULL, unless blocks are written
+		through one of those.
+
+The block callbacks return 0 on success or an enum usb_msc_media_status,
+which is reported to the host as a failed command with matching sense data.
 
 @return Pointer to the usbd_mass_storage struct.
 */
@@ -821,18 +1496,24 @@ usbd_mass_storage *usb_msc_init(usbd_device *usbd_dev,
 	_mass_storage.block_count = block_count - 1;
 	_mass_storage.read_block = read_block;
 	_mass_storage.write_block = write_block;
+	_mass_storage.read_blocks = NULL;
+	_mass_storage.write_blocks = NULL;
+	_mass_storage.start_read = NULL;
+	_mass_storage.start_write = NULL;
 	_mass_storage.lock = NULL;
 	_mass_storage.unlock = NULL;
-
-	_mass_storage.trans.lba_start = 0xffffffff;
-	_mass_storage.trans.block_count = 0;
-	_mass_storage.trans.current_block = 0;
-	_mass_storage.trans.cbw_cnt = 0;
-	_mass_storage.trans.bytes_to_read = 0;
-	_mass_storage.trans.bytes_to_write = 0;
-	_mass_storage.trans.byte_count = 0;
-	_mass_storage.trans.csw_valid = false;
-	_mass_storage.trans.csw_sent = 0;
+	_mass_storage.media_busy = false;
+	_mass_storage.media_stale = false;
+	_mass_storage.cache = NULL;
+	_mass_storage.cache_lba = MSC_CACHE_NONE;
+	_mass_storage.cache_dirty = false;
+	_mass_storage.trans.pipe = MSC_PIPE_IDLE;
+
+	_mass_storage.buf[0] = _msc_buf[0];
+	_mass_storage.buf[1] = _msc_buf[1];
+	_mass_storage.buf_blocks = 1;
+	_mass_storage.trans.msd_buf = _msc_buf[0];
+	msc_reset_trans(&_mass_storage);
 
 	set_sbc_status_good(&_mass_storage);
 
@@ -841,4 +1522,190 @@ usbd_mass_storage *usb_msc_init(usbd_device *usbd_dev,
 	return &_mass_storage;
 }
 
+/** @brief Move several blocks per backend call.
+
+Either callback may be NULL, the single block callback given to
+@ref usb_msc_init is used for that direction then.
+
+@param[in] ms The mass storage device returned by @ref usb_msc_init.
+@param[in] read_blocks Read count consecutive blocks starting at lba.
+@param[in] write_blocks Write count consecutive blocks starting at lba.
+*/
+void usb_msc_set_block_callbacks(usbd_mass_storage *ms,
+				 int (*read_blocks)(uint32_t lba,
+						    uint8_t *copy_to,
+						    uint32_t count),
+				 int (*write_blocks)(uint32_t lba,
+						     const uint8_t *copy_from,
+						     uint32_t count))
+{
+	ms->read_blocks = read_blocks;
+	ms->write_blocks = write_blocks;
+}
+
+/** @brief Use larger buffers for block data.
+
+The buffer is split in two halves of whole 512-byte blocks: one half
+moves over USB while the backend reads into or writes from the other. Larger
+halves mean fewer, longer backend calls and USB transfers. Keep it word
+aligned for drivers that move data by DMA.
+
+@param[in] ms The mass storage device returned by @ref usb_msc_init.
+@param[in] buf The buffer, must stay valid.
+@param[in] len Size of buf in bytes.
+
+@return 0 on success, -1 if buf does not hold two blocks.
+*/
+int usb_msc_set_buffer(usbd_mass_storage *ms, uint8_t *buf, uint32_t len)
+{
+	uint32_t blocks = len / (2 * MSC_BLOCK_SIZE);
+
+	if (!blocks) {
+		return -1;
+	}
+
+	ms->buf[0] = buf;
+	ms->buf[1] = buf + blocks * MSC_BLOCK_SIZE;
+	ms->buf_blocks = blocks;
+	ms->trans.msd_buf = buf;
+	return 0;
+}
+
+/** @brief Cache writes in erase block units.
+
+Flash that erases in blocks larger than 512 bytes has to read, erase and
+rewrite a whole erase block for every block written to it. With the cache,
+writes collect in buf and reach the backend one whole, aligned erase block at
+a time, blocks the host did not write read back first. Reads see the cached
+blocks.
+
+The cache is written back when a write moves on to another erase block, on
+SYNCHRONIZE CACHE and START STOP UNIT, after timeout calls of
+@ref usb_msc_cache_tick without a write, and on @ref usb_msc_cache_flush.
+Data still cached is lost if the device loses power, so keep the timeout
+short.
+
+The cache goes through the blocking block callbacks, also when asynchronous
+ones are set.
+
+@param[in] ms The mass storage device returned by @ref usb_msc_init.
+@param[in] buf Space for one erase block, must stay valid.
+@param[in] len Erase block size in bytes, a multiple of 512 up to 128 KiB.
+@param[in] timeout Idle ticks before the cache is written back, 0 for never.
+
+@return 0 on success, -1 for an unsupported size or without blocking
+callbacks.
+*/
+int usb_msc_set_write_cache(usbd_mass_storage *ms, uint8_t *buf, uint32_t len,
+			    uint16_t timeout)
+{
+	uint32_t blocks = len / MSC_BLOCK_SIZE;
+
+	if (!blocks || blocks > MSC_CACHE_MAX_BLOCKS ||
+	    len % MSC_BLOCK_SIZE ||
+	    (!ms->read_blocks && !ms->read_block) ||
+	    (!ms->write_blocks && !ms->write_block)) {
+		return -1;
+	}
+
+	ms->cache = buf;
+	ms->cache_blocks = blocks;
+	ms->cache_lba = MSC_CACHE_NONE;
+	ms->cache_dirty = false;
+	ms->cache_idle = 0;
+	ms->cache_timeout = timeout;
+	return 0;
+}
+
+/** @brief Count idle time for the write cache.
+
+Call at a steady rate, from the context that runs @ref usbd_poll, the SOF
+callback for example. A backend operation in flight defers the write-back.
+
+@param[in] ms The mass storage device returned by @ref usb_msc_init.
+*/
+void usb_msc_cache_tick(usbd_mass_storage *ms)
+{
+	if (!ms->cache_dirty || !ms->cache_timeout || ms->media_busy) {
+		return;
+	}
+
+	if (++ms->cache_idle >= ms->cache_timeout) {
+		/* A failure is retried after another timeout. */
+		ms->cache_idle = 0;
+		msc_cache_flush(ms);
+	}
+}
+
+/** @brief Write the cache back now, before a power down for example.
+
+Call from the context that runs @ref usbd_poll, or with the USB interrupt
+masked.
+
+@param[in] ms The mass storage device returned by @ref usb_msc_init.
+
+@return 0 on success or the enum usb_msc_media_status of the backend.
+*/
+int usb_msc_cache_flush(usbd_mass_storage *ms)
+{
+	return msc_cache_flush(ms);
+}
+
+/** @brief Move blocks without blocking the USB stack.
+
+A start callback only kicks off the media operation, DMA driven for example,
+and returns. The backend calls @ref usb_msc_media_done once it is done; until
+then the bulk endpoints NAK the host. Only one operation runs at a time.
+
+Either callback may be NULL, the blocking callbacks are used for that
+direction then. FORMAT UNIT only runs with a blocking write callback and
+fails without one.
+
+@param[in] ms The mass storage device returned by @ref usb_msc_init.
+@param[in] start_read Start reading count blocks at lba into copy_to.
+@param[in] start_write Start writing count blocks at lba from copy_from.
+*/
+void usb_msc_set_async_callbacks(usbd_mass_storage *ms,
+				 void (*start_read)(uint32_t lba,
+						    uint8_t *copy_to,
+						    uint32_t count),
+				 void (*start_write)(uint32_t lba,
+						     const uint8_t *copy_from,
+						     uint32_t count))
+{
+	ms->start_read = start_read;
+	ms->start_write = start_write;
+}
+
+/** @brief Finish the media operation started by an asynchronous callback.
+
+Must be called from the context that runs @ref usbd_poll, or with the USB
+interrupt masked. It may be called from within the start callback. An
+operation that was running when the host reset the device still has to be
+finished: its result is dropped and the next command waits for it.
+
+@param[in] ms The mass storage device returned by @ref usb_msc_init.
+@param[in] status 0 on success or an enum usb_msc_media_status.
+*/
+void usb_msc_media_done(usbd_mass_storage *ms, int status)
+{
+	bool stale = ms->media_stale;
+
+	if (!ms->media_busy) {
+		return;
+	}
+
+	msc_media_finish(ms, status);
+	if (stale) {
+		/* Commands were held off until the buffers are free again. */
+		msc_receive_cbw(ms);
+		return;
+	}
+	if (MSC_PIPE_READ == ms->trans.pipe) {
+		msc_read_pump(ms);
+	} else {
+		msc_write_pump(ms);
+	}
+}
+
 /** @} */
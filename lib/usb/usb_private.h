@@ -53,10 +53,16 @@ struct _usbd_device {
 	uint8_t *ctrl_buf;  /**< Internal buffer used for control transfers */
 	uint16_t ctrl_buf_len;
 
+	/* Serialized configuration descriptors, see usbd_register_config_cache */
+	uint8_t *config_cache;
+	uint16_t config_cache_len;
+	bool config_cache_valid;
+	enum usbd_speed config_cache_speed;
+
 	uint8_t current_address;
 	uint8_t current_config;
+	enum usbd_speed speed;
 
-	uint16_t pm_top;    /**< Top of allocated endpoint buffer memory */
 
 	/* User callback functions for various USB events */
 	void (*user_callback_reset)(void);
@@ -85,6 +91,20 @@ struct _usbd_device {
 
 	usbd_endpoint_callback user_callback_ctr[8][3];
 
+	/* Multi-packet transfers, indexed like user_callback_ctr */
+	struct usbd_transfer {
+		uint8_t *buf;
+		uint32_t len;
+		uint32_t done;
+		usbd_transfer_callback callback;
+		/* Endpoint callback to restore once the transfer is done */
+		usbd_endpoint_callback ep_callback;
+		uint16_t max_size;
+		uint8_t in_flight;	/* IN packets handed to the hardware */
+		bool zlp;		/* IN transfer still owes a ZLP */
+		bool active;
+	} transfer[8][2];
+
 	/* User callback function for some standard USB function hooks */
 	usbd_set_config_callback user_callback_set_config[MAX_USER_SET_CONFIG_CALLBACK];
 
@@ -112,6 +132,21 @@ struct _usbd_device {
 	 * for use in stm32f107_ep_read_packet().
 	 */
 	uint16_t rxbcnt;
+	/*
+	 * DMA mode of the DWC core. Each endpoint direction gets a word
+	 * aligned bounce buffer out of dma_mem for the packet interface.
+	 * dma_len is the length of a transfer handed to the DMA engine as a
+	 * whole, 0 if the endpoint is in packet mode.
+	 */
+	bool dma;
+	uint32_t *dma_mem;
+	uint16_t dma_mem_size;	/* in words */
+	uint16_t dma_mem_top;
+	uint16_t dma_mem_top_ep0;
+	uint32_t *dma_buf[4][2];
+	uint8_t *dma_xfer_buf[4][2];
+	uint32_t dma_xfer_len[4][2];
+	uint32_t dma_xfer_done[4][2];
 };
 
 enum _usbd_transaction {
@@ -127,6 +162,9 @@ void _usbd_control_in(usbd_device *usbd_dev, uint8_t ea);
 void _usbd_control_out(usbd_device *usbd_dev, uint8_t ea);
 void _usbd_control_setup(usbd_device *usbd_dev, uint8_t ea);
 
+void _usbd_transfer_reset(usbd_device *usbd_dev);
+void _usbd_transfer_done(usbd_device *usbd_dev, uint8_t addr, uint32_t len);
+
 enum usbd_request_return_codes _usbd_standard_request_device(usbd_device *usbd_dev,
 				  struct usb_setup_data *req, uint8_t **buf,
 				  uint16_t *len);
@@ -140,13 +178,15 @@ enum usbd_request_return_codes _usbd_standard_request(usbd_device *usbd_dev, str
 			   uint8_t **buf, uint16_t *len);
 
 void _usbd_reset(usbd_device *usbd_dev);
+uint16_t _usbd_ep_max_size(uint8_t type, uint16_t max_size,
+			   enum usbd_speed speed);
 
 /* Functions provided by the hardware abstraction. */
 struct _usbd_driver {
 	usbd_device *(*init)(void);
 	void (*set_address)(usbd_device *usbd_dev, uint8_t addr);
-	void (*ep_setup)(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
-			 uint16_t max_size, usbd_endpoint_callback cb);
+	int (*ep_setup)(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
+			uint16_t max_size, usbd_endpoint_callback cb);
 	void (*ep_reset)(usbd_device *usbd_dev);
 	void (*ep_stall_set)(usbd_device *usbd_dev, uint8_t addr,
 			     uint8_t stall);
@@ -157,10 +197,21 @@ struct _usbd_driver {
 	uint16_t (*ep_read_packet)(usbd_device *usbd_dev, uint8_t addr,
 				   void *buf, uint16_t len);
 	void (*poll)(usbd_device *usbd_dev);
+	/*
+	 * Optional: move a whole transfer without the packet interface.
+	 * Returns -1 to fall back to packets. On completion the driver calls
+	 * _usbd_transfer_done().
+	 */
+	int (*ep_transfer)(usbd_device *usbd_dev, uint8_t addr, void *buf,
+			   uint32_t len);
+	/* Optional: a transfer queued with ep_transfer was dropped. */
+	void (*ep_transfer_cancel)(usbd_device *usbd_dev, uint8_t addr);
 	void (*disconnect)(usbd_device *usbd_dev, bool disconnected);
 	uint32_t base_address;
 	bool set_address_before_status;
 	uint16_t rx_fifo_size;
+	uint16_t fifo_size;	/* Total FIFO RAM in 32-bit words, 0 if unknown */
+	bool high_speed;	/* Can run at high speed */
 };
 
 #endif
@@ -66,7 +66,8 @@ void usbd_register_set_altsetting_callback(usbd_device *usbd_dev,
 }
 
 static uint16_t build_config_descriptor(usbd_device *usbd_dev,
-				   uint8_t index, uint8_t *buf, uint16_t len)
+				   uint8_t index, enum usbd_speed speed,
+				   uint8_t *buf, uint16_t len)
 {
 	uint8_t *tmpbuf = buf;
 	const struct usb_config_descriptor *cfg = &usbd_dev->config[index];
@@ -114,7 +115,17 @@ static uint16_t build_config_descriptor(usbd_device *usbd_dev,
 			for (k = 0; k < iface->bNumEndpoints; k++) {
 				const struct usb_endpoint_descriptor *ep =
 				    &iface->endpoint[k];
+				uint16_t max_size = _usbd_ep_max_size(
+					ep->bmAttributes, ep->wMaxPacketSize,
+					speed);
 				memcpy(buf, ep, count = MIN(len, ep->bLength));
+				/* Bulk endpoint size depends on the bus speed. */
+				if (count > 4) {
+					buf[4] = max_size & 0xff;
+				}
+				if (count > 5) {
+					buf[5] = max_size >> 8;
+				}
 				buf += count;
 				len -= count;
 				total += count;
@@ -139,6 +150,78 @@ static uint16_t build_config_descriptor(usbd_device *usbd_dev,
 	return total;
 }
 
+static uint16_t config_total_length(const uint8_t *cfg)
+{
+	uint16_t totallen;
+
+	/* Not necessarily halfword-aligned. */
+	memcpy(&totallen, cfg + 2, sizeof(uint16_t));
+	return totallen;
+}
+
+static int build_config_cache(usbd_device *usbd_dev)
+{
+	uint8_t *buf = usbd_dev->config_cache;
+	uint16_t len = usbd_dev->config_cache_len;
+	uint16_t count;
+	int i;
+
+	usbd_dev->config_cache_valid = false;
+	for (i = 0; i < usbd_dev->desc->bNumConfigurations; i++) {
+		if (len < USB_DT_CONFIGURATION_SIZE) {
+			return -1;
+		}
+		count = build_config_descriptor(usbd_dev, i, usbd_dev->speed,
+						buf, len);
+		if (count != config_total_length(buf)) {
+			return -1;
+		}
+		buf += count;
+		len -= count;
+	}
+
+	usbd_dev->config_cache_speed = usbd_dev->speed;
+	usbd_dev->config_cache_valid = true;
+	return 0;
+}
+
+/* Point buf at configuration index in the cache, if there is one. */
+static bool config_cache_get(usbd_device *usbd_dev, int index,
+			     uint8_t **buf, uint16_t *len)
+{
+	uint8_t *cfg = usbd_dev->config_cache;
+	int i;
+
+	if (!usbd_dev->config_cache ||
+	    index >= usbd_dev->desc->bNumConfigurations) {
+		return false;
+	}
+	if ((!usbd_dev->config_cache_valid ||
+	     usbd_dev->config_cache_speed != usbd_dev->speed) &&
+	    build_config_cache(usbd_dev)) {
+		return false;
+	}
+
+	for (i = 0; i < index; i++) {
+		cfg += config_total_length(cfg);
+	}
+	*buf = cfg;
+	*len = MIN(*len, config_total_length(cfg));
+	return true;
+}
+
+int usbd_register_config_cache(usbd_device *usbd_dev, uint8_t *buf,
+			       uint16_t len)
+{
+	usbd_dev->config_cache = buf;
+	usbd_dev->config_cache_len = len;
+	if (build_config_cache(usbd_dev)) {
+		usbd_dev->config_cache = NULL;
+		return -1;
+	}
+	return 0;
+}
+
 static int usb_descriptor_type(uint16_t wValue)
 {
 	return wValue >> 8;
@@ -156,6 +239,8 @@ usb_standard_get_descriptor(usbd_device *usbd_dev,
 {
 	int i, array_idx, descr_idx;
 	struct usb_string_descriptor *sd;
+	struct usb_device_qualifier_descriptor *qd;
+	enum usbd_speed speed;
 
 	descr_idx = usb_descriptor_index(req->wValue);
 
@@ -165,8 +250,43 @@ usb_standard_get_descriptor(usbd_device *usbd_dev,
 		*len = MIN(*len, usbd_dev->desc->bLength);
 		return USBD_REQ_HANDLED;
 	case USB_DT_CONFIGURATION:
+		if (config_cache_get(usbd_dev, descr_idx, buf, len)) {
+			return USBD_REQ_HANDLED;
+		}
 		*buf = usbd_dev->ctrl_buf;
-		*len = build_config_descriptor(usbd_dev, descr_idx, *buf, *len);
+		*len = build_config_descriptor(usbd_dev, descr_idx,
+					       usbd_dev->speed, *buf, *len);
+		return USBD_REQ_HANDLED;
+	case USB_DT_DEVICE_QUALIFIER:
+		/* Full speed only devices must stall this request. */
+		if (!usbd_dev->driver->high_speed) {
+			return USBD_REQ_NOTSUPP;
+		}
+		qd = (struct usb_device_qualifier_descriptor *)usbd_dev->ctrl_buf;
+		qd->bLength = USB_DT_DEVICE_QUALIFIER_SIZE;
+		qd->bDescriptorType = USB_DT_DEVICE_QUALIFIER;
+		qd->bcdUSB = usbd_dev->desc->bcdUSB;
+		qd->bDeviceClass = usbd_dev->desc->bDeviceClass;
+		qd->bDeviceSubClass = usbd_dev->desc->bDeviceSubClass;
+		qd->bDeviceProtocol = usbd_dev->desc->bDeviceProtocol;
+		qd->bMaxPacketSize0 = usbd_dev->desc->bMaxPacketSize0;
+		qd->bNumConfigurations = usbd_dev->desc->bNumConfigurations;
+		qd->bReserved = 0;
+		*buf = (uint8_t *)qd;
+		*len = MIN(*len, qd->bLength);
+		return USBD_REQ_HANDLED;
+	case USB_DT_OTHER_SPEED_CONFIGURATION:
+		if (!usbd_dev->driver->high_speed) {
+			return USBD_REQ_NOTSUPP;
+		}
+		speed = usbd_dev->speed == USBD_SPEED_HIGH ?
+			USBD_SPEED_FULL : USBD_SPEED_HIGH;
+		*buf = usbd_dev->ctrl_buf;
+		*len = build_config_descriptor(usbd_dev, descr_idx, speed,
+					       *buf, *len);
+		if (*len > 1) {
+			(*buf)[1] = USB_DT_OTHER_SPEED_CONFIGURATION;
+		}
 		return USBD_REQ_HANDLED;
 	case USB_DT_STRING:
 		sd = (struct usb_string_descriptor *)usbd_dev->ctrl_buf;
@@ -302,6 +422,7 @@ usb_standard_set_configuration(usbd_device *usbd_dev,
 	}
 
 	/* Reset all endpoints. */
+	_usbd_transfer_reset(usbd_dev);
 	usbd_dev->driver->ep_reset(usbd_dev);
 
 	if (usbd_dev->user_callback_set_config[0]) {
@@ -0,0 +1,222 @@
+/** @defgroup usb_transfer_file Generic USB Transfers
+
+@ingroup USB
+
+@brief <b>Generic USB Multi-Packet Transfers</b>
+
+Bulk, interrupt and isochronous transfers longer than one packet, fed from
+the transfer complete path of the driver.
+
+LGPL License Terms @ref lgpl_license
+*/
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <stdlib.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/usb/usbd.h>
+#include "usb_private.h"
+
+/*
+ * While a transfer is queued its endpoint callback slot points at one of
+ * the handlers below; the endpoint callback of the user is parked in the
+ * transfer and put back when the transfer ends.
+ *
+ * An OUT endpoint NAKs from the end of a transfer until the next one is
+ * queued, so the host can't send a packet nobody is waiting for.
+ *
+ * Queueing and cancelling run with interrupts masked: the first packets go
+ * out before the transfer state is updated, and an endpoint interrupt in
+ * between would see an idle transfer and send them again.
+ */
+
+static void usbd_transfer_finish(usbd_device *usbd_dev, uint8_t ep,
+				 uint8_t dir)
+{
+	struct usbd_transfer *t = &usbd_dev->transfer[ep][dir];
+
+	t->active = false;
+	usbd_dev->user_callback_ctr[ep][dir] = t->ep_callback;
+	if (dir == USB_TRANSACTION_OUT) {
+		usbd_ep_nak_set(usbd_dev, ep, 1);
+	}
+	if (t->callback) {
+		t->callback(usbd_dev,
+			    dir == USB_TRANSACTION_IN ? ep | 0x80 : ep,
+			    t->done);
+	}
+}
+
+/*
+ * Hand the endpoint as many packets as it takes: one, or two when it is
+ * double buffered. A zero length packet is only written to an idle endpoint,
+ * as write_packet can't report a busy endpoint for it.
+ */
+static void usbd_transfer_in_feed(usbd_device *usbd_dev, uint8_t ep)
+{
+	struct usbd_transfer *t = &usbd_dev->transfer[ep][USB_TRANSACTION_IN];
+
+	while (t->done < t->len) {
+		uint16_t len = MIN(t->len - t->done, t->max_size);
+
+		if (!usbd_ep_write_packet(usbd_dev, ep, t->buf + t->done, len)) {
+			return;
+		}
+		t->done += len;
+		t->in_flight++;
+	}
+
+	if (t->zlp && !t->in_flight) {
+		usbd_ep_write_packet(usbd_dev, ep, NULL, 0);
+		t->zlp = false;
+		t->in_flight++;
+	}
+}
+
+static void usbd_transfer_in(usbd_device *usbd_dev, uint8_t ep)
+{
+	struct usbd_transfer *t = &usbd_dev->transfer[ep][USB_TRANSACTION_IN];
+
+	if (t->in_flight) {
+		t->in_flight--;
+	}
+	usbd_transfer_in_feed(usbd_dev, ep);
+
+	if (!t->in_flight) {
+		usbd_transfer_finish(usbd_dev, ep, USB_TRANSACTION_IN);
+	}
+}
+
+static void usbd_transfer_out(usbd_device *usbd_dev, uint8_t ep)
+{
+	struct usbd_transfer *t = &usbd_dev->transfer[ep][USB_TRANSACTION_OUT];
+	uint16_t len = MIN(t->len - t->done, t->max_size);
+
+	/* NAK before the last packet is read, the driver re-enables on read. */
+	if (t->done + len == t->len) {
+		usbd_ep_nak_set(usbd_dev, ep, 1);
+	}
+	len = usbd_ep_read_packet(usbd_dev, ep, t->buf + t->done, len);
+	t->done += len;
+
+	if (len < t->max_size || t->done == t->len) {
+		usbd_transfer_finish(usbd_dev, ep, USB_TRANSACTION_OUT);
+	}
+}
+
+int usbd_ep_transfer(usbd_device *usbd_dev, uint8_t addr, void *buf,
+		     uint32_t len, bool zlp, usbd_transfer_callback callback)
+{
+	uint8_t ep = addr & 0x7f;
+	uint8_t dir = (addr & 0x80) ? USB_TRANSACTION_IN : USB_TRANSACTION_OUT;
+	struct usbd_transfer *t = &usbd_dev->transfer[ep][dir];
+	uint32_t mask;
+
+	if (!ep || !t->max_size) {
+		return -1;
+	}
+
+	mask = cm_mask_interrupts(1);
+	if (t->active) {
+		cm_mask_interrupts(mask);
+		return -1;
+	}
+
+	t->buf = buf;
+	t->len = len;
+	t->done = 0;
+	t->in_flight = 0;
+	t->callback = callback;
+	t->zlp = (dir == USB_TRANSACTION_IN) &&
+		 (!len || (zlp && !(len % t->max_size)));
+	t->active = true;
+
+	t->ep_callback = usbd_dev->user_callback_ctr[ep][dir];
+	if (dir == USB_TRANSACTION_IN) {
+		usbd_dev->user_callback_ctr[ep][dir] = usbd_transfer_in;
+	} else {
+		usbd_dev->user_callback_ctr[ep][dir] = usbd_transfer_out;
+	}
+
+	if (usbd_dev->driver->ep_transfer &&
+	    !usbd_dev->driver->ep_transfer(usbd_dev, addr, buf, len)) {
+		if (dir == USB_TRANSACTION_OUT) {
+			usbd_ep_nak_set(usbd_dev, ep, 0);
+		}
+	} else if (dir == USB_TRANSACTION_IN) {
+		usbd_transfer_in_feed(usbd_dev, ep);
+	} else {
+		usbd_ep_nak_set(usbd_dev, ep, 0);
+	}
+
+	cm_mask_interrupts(mask);
+	return 0;
+}
+
+/*
+ * Called by a driver that moved the whole transfer itself. A terminating
+ * zero length packet still goes through the packet interface.
+ */
+void _usbd_transfer_done(usbd_device *usbd_dev, uint8_t addr, uint32_t len)
+{
+	uint8_t ep = addr & 0x7f;
+	uint8_t dir = (addr & 0x80) ? USB_TRANSACTION_IN : USB_TRANSACTION_OUT;
+	struct usbd_transfer *t = &usbd_dev->transfer[ep][dir];
+
+	if (!t->active) {
+		return;
+	}
+
+	t->done = len;
+	if (t->zlp) {
+		usbd_transfer_in_feed(usbd_dev, ep);
+		return;
+	}
+	usbd_transfer_finish(usbd_dev, ep, dir);
+}
+
+void usbd_ep_transfer_cancel(usbd_device *usbd_dev, uint8_t addr)
+{
+	uint8_t ep = addr & 0x7f;
+	uint8_t dir = (addr & 0x80) ? USB_TRANSACTION_IN : USB_TRANSACTION_OUT;
+	struct usbd_transfer *t = &usbd_dev->transfer[ep][dir];
+	uint32_t mask = cm_mask_interrupts(1);
+
+	if (t->active) {
+		t->active = false;
+		usbd_dev->user_callback_ctr[ep][dir] = t->ep_callback;
+		if (usbd_dev->driver->ep_transfer_cancel) {
+			usbd_dev->driver->ep_transfer_cancel(usbd_dev, addr);
+		}
+	}
+	cm_mask_interrupts(mask);
+}
+
+void _usbd_transfer_reset(usbd_device *usbd_dev)
+{
+	int i;
+
+	for (i = 1; i < 8; i++) {
+		usbd_ep_transfer_cancel(usbd_dev, i);
+		usbd_ep_transfer_cancel(usbd_dev, i | 0x80);
+	}
+}
+
+/**@}*/
@@ -0,0 +1,39 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Busy waits based on the DWT cycle counter, as the gd32 port has no
+ * timer driver to borrow TIM6 from.
+ */
+#include <stdint.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/stm32/rcc.h>
+
+#include "delay.h"
+
+void delay_setup(void)
+{
+	dwt_enable_cycle_counter();
+}
+
+void delay_us(uint16_t us)
+{
+	uint32_t start = dwt_read_cycle_counter();
+	uint32_t cycles = us * (rcc_ahb_frequency / 1000000);
+
+	while (dwt_read_cycle_counter() - start < cycles);
+}
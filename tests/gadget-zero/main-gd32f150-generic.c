@@ -0,0 +1,65 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+
+#include <stdio.h>
+#include "usb-gadget0.h"
+
+#define ER_DEBUG
+#ifdef ER_DEBUG
+#define ER_DPRINTF(fmt, ...) \
+	do { printf(fmt, ## __VA_ARGS__); } while (0)
+#else
+#define ER_DPRINTF(fmt, ...) \
+	do { } while (0)
+#endif
+
+int main(void)
+{
+	/* USBD needs the 48MHz USB clock, only reachable from the HSE PLL */
+	rcc_clock_setup_pll(&rcc_hse8_configs[RCC_CLOCK_HSE8_72MHZ]);
+	/* LED to indicate boot process */
+	rcc_periph_clock_enable(RCC_GPIOC);
+	gpio_mode_setup(GPIOC, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, GPIO13);
+	gpio_set(GPIOC, GPIO13);
+
+	rcc_periph_clock_enable(RCC_GPIOA);
+	/*
+	 * Vile hack to reenumerate, physically _drag_ d+ low.
+	 * do NOT do this if you're board has proper usb pull up control!
+	 * (need at least 2.5us to trigger usb disconnect)
+	 */
+	gpio_mode_setup(GPIOA, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, GPIO12);
+	gpio_clear(GPIOA, GPIO12);
+	for (unsigned int i = 0; i < 800000; i++) {
+		__asm__("nop");
+	}
+	gpio_mode_setup(GPIOA, GPIO_MODE_INPUT, GPIO_PUPD_NONE, GPIO12);
+
+	usbd_device *usbd_dev = gadget0_init(&st_usbfs_v1_usb_driver,
+					     "gd32f150-generic");
+
+	ER_DPRINTF("bootup complete\n");
+	gpio_clear(GPIOC, GPIO13);
+	while (1) {
+		gadget0_run(usbd_dev);
+	}
+
+}
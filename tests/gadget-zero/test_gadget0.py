@@ -15,6 +15,7 @@ import random
 import usb.core
 import usb.util as uu
 import random
+import struct
 import sys
 
 import unittest
@@ -28,6 +29,7 @@ DUT_SERIAL=None
 #DUT_SERIAL = "stm32f429i-disco"
 #DUT_SERIAL = "stm32f4disco"
 #DUT_SERIAL = "stm32f103-generic"
+#DUT_SERIAL = "gd32f150-generic"
 #DUT_SERIAL = "stm32l1-generic"
 #DUT_SERIAL = "stm32f072disco"
 #DUT_SERIAL = "stm32l053disco"
@@ -36,6 +38,7 @@ GZ_REQ_SET_PATTERN=1
 GZ_REQ_PRODUCE=2
 GZ_REQ_SET_ALIGNED=3
 GZ_REQ_SET_UNALIGNED=4
+GZ_REQ_READ_COPY_CYCLES=5
 GZ_REQ_WRITE_LOOPBACK_BUFFER=10
 GZ_REQ_READ_LOOPBACK_BUFFER=11
 GZ_REQ_INTEL_WRITE=0x5b
@@ -353,6 +356,17 @@ class TestConfigSourceSinkPerformance(unittest.TestCase):
         te = datetime.datetime.now() - ts
         print("wrote %s bytes in %s for %s kps" % (txc, te, self.tput(txc, te)))
 
+    def test_copy_cycles(self):
+        # cycles per 64 byte packet, track these release over release
+        for name, req in (("aligned", GZ_REQ_SET_ALIGNED), ("unaligned", GZ_REQ_SET_UNALIGNED)):
+            self.dev.ctrl_transfer(uu.CTRL_TYPE_VENDOR | uu.CTRL_RECIPIENT_INTERFACE, req, 0)
+            self.ep_out.write([x & 0xff for x in range(64 * 8)])
+            self.ep_in.read(64 * 8)
+            cycles = self.dev.ctrl_transfer(uu.CTRL_IN | uu.CTRL_TYPE_VENDOR | uu.CTRL_RECIPIENT_INTERFACE, GZ_REQ_READ_COPY_CYCLES, 0, 0, 8)
+            rd, wr = struct.unpack("<II", cycles)
+            print("%s: read_packet %d cycles, write_packet %d cycles" % (name, rd, wr))
+        self.dev.ctrl_transfer(uu.CTRL_TYPE_VENDOR | uu.CTRL_RECIPIENT_INTERFACE, GZ_REQ_SET_ALIGNED, 0)
+
 
 class TestControlTransfer_Reads(unittest.TestCase):
     """
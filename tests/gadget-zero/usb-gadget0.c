@@ -25,6 +25,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <libopencm3/cm3/dwt.h>
 #include <libopencm3/usb/usbd.h>
 
 #include "trace.h"
@@ -48,6 +49,7 @@
 #define GZ_REQ_PRODUCE		2
 #define GZ_REQ_SET_ALIGNED	3
 #define GZ_REQ_SET_UNALIGNED	4
+#define GZ_REQ_READ_COPY_CYCLES	5
 #define INTEL_COMPLIANCE_WRITE 0x5b
 #define INTEL_COMPLIANCE_READ 0x5c
 
@@ -197,6 +199,9 @@ static struct {
 	uint8_t pattern;
 	int pattern_counter;
 	int test_unaligned;	/* If 0 (default), use 16-bit aligned buffers. This should not be declared as bool */
+	/* CPU cycles spent in the last source/sink packet read and write */
+	uint32_t read_cycles;
+	uint32_t write_cycles;
 } state = {
 	.pattern = 0,
 	.pattern_counter = 0,
@@ -218,7 +223,9 @@ static void gadget0_ss_out_cb(usbd_device *usbd_dev, uint8_t ep)
 	} else {
 		dest = buf;
 	}
+	uint32_t start = dwt_read_cycle_counter();
 	x = usbd_ep_read_packet(usbd_dev, ep, dest, BULK_EP_MAXPACKET);
+	state.read_cycles = dwt_read_cycle_counter() - start;
 	trace_send_blocking8(1, x);
 }
 
@@ -246,7 +253,9 @@ static void gadget0_ss_in_cb(usbd_device *usbd_dev, uint8_t ep)
 		break;
 	}
 
+	uint32_t start = dwt_read_cycle_counter();
 	uint16_t x = usbd_ep_write_packet(usbd_dev, ep, src, BULK_EP_MAXPACKET);
+	state.write_cycles = dwt_read_cycle_counter() - start;
 	/* As we are calling write in the callback, this should never fail */
 	trace_send_blocking8(2, x);
 	if (x != BULK_EP_MAXPACKET) {
@@ -322,6 +331,16 @@ static enum usbd_request_return_codes gadget0_control_request(usbd_device *usbd_
 	case GZ_REQ_SET_ALIGNED:
 		state.test_unaligned = 0;
 		return USBD_REQ_HANDLED;
+	case GZ_REQ_READ_COPY_CYCLES:
+		/* Both counts read as zero on cores without a cycle counter */
+		if (req->wLength < 2 * sizeof(uint32_t)) {
+			return USBD_REQ_NOTSUPP;
+		}
+		memcpy(*buf, &state.read_cycles, sizeof(uint32_t));
+		memcpy(*buf + sizeof(uint32_t), &state.write_cycles,
+		       sizeof(uint32_t));
+		*len = 2 * sizeof(uint32_t);
+		return USBD_REQ_HANDLED;
 	case GZ_REQ_PRODUCE:
 		ER_DPRINTF("fake loopback of %d\n", req->wValue);
 		if (req->wValue > sizeof(usbd_control_buffer)) {
@@ -397,6 +416,7 @@ usbd_device *gadget0_init(const usbd_driver *driver, const char *userserial)
 
 	usbd_register_set_config_callback(our_dev, gadget0_set_config);
 	delay_setup();
+	dwt_enable_cycle_counter();
 
 	return our_dev;
 }
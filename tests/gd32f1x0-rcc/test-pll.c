@@ -0,0 +1,244 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* rcc_clock_compute_pll() against a table of expected configurations. */
+
+#include <stdio.h>
+#include <libopencm3/gd32/rcc.h>
+#include <libopencm3/gd32/flash.h>
+
+#define MHZ			1000000
+
+struct pll_case {
+	uint32_t sysclk;
+	uint32_t hse;
+	bool usb;
+	/* NULL if no configuration must be found */
+	const struct rcc_clock_scale *expected;
+};
+
+static const struct rcc_clock_scale hsi_72mhz = {
+	.pllmul = RCC_CFGR_PLLMUL_PLL_CLK_MUL18,
+	.hpre = RCC_CFGR_HPRE_NODIV,
+	.ppre1 = RCC_CFGR_PPRE_DIV2,
+	.ppre2 = RCC_CFGR_PPRE_NODIV,
+	.adcpre = RCC_CFGR_ADCPRE_DIV8,
+	.use_hse = false,
+	.flash_waitstates = FLASH_ACR_LATENCY_2WS,
+	.ahb_frequency = 72000000,
+	.apb1_frequency = 36000000,
+	.apb2_frequency = 72000000,
+};
+
+static const struct rcc_clock_scale hse8_48mhz = {
+	.pllmul = RCC_CFGR_PLLMUL_PLL_CLK_MUL6,
+	.hpre = RCC_CFGR_HPRE_NODIV,
+	.ppre1 = RCC_CFGR_PPRE_DIV2,
+	.ppre2 = RCC_CFGR_PPRE_NODIV,
+	.adcpre = RCC_CFGR_ADCPRE_DIV8,
+	.usbpre = RCC_CFGR_USBPRE_PLL_CLK_DIV1_5,
+	.use_hse = true,
+	.pll_hse_prediv = RCC_CFGR2_PREDIV_NODIV,
+	.flash_waitstates = FLASH_ACR_LATENCY_1WS,
+	.ahb_frequency = 48000000,
+	.apb1_frequency = 24000000,
+	.apb2_frequency = 48000000,
+};
+
+static const struct rcc_clock_scale hse8_48mhz_usb = {
+	.pllmul = RCC_CFGR_PLLMUL_PLL_CLK_MUL6,
+	.hpre = RCC_CFGR_HPRE_NODIV,
+	.ppre1 = RCC_CFGR_PPRE_DIV2,
+	.ppre2 = RCC_CFGR_PPRE_NODIV,
+	.adcpre = RCC_CFGR_ADCPRE_DIV8,
+	.usbpre = RCC_CFGR_USBPRE_PLL_CLK_NODIV,
+	.use_hse = true,
+	.pll_hse_prediv = RCC_CFGR2_PREDIV_NODIV,
+	.flash_waitstates = FLASH_ACR_LATENCY_1WS,
+	.ahb_frequency = 48000000,
+	.apb1_frequency = 24000000,
+	.apb2_frequency = 48000000,
+};
+
+static const struct rcc_clock_scale hse8_64mhz = {
+	.pllmul = RCC_CFGR_PLLMUL_PLL_CLK_MUL8,
+	.hpre = RCC_CFGR_HPRE_NODIV,
+	.ppre1 = RCC_CFGR_PPRE_DIV2,
+	.ppre2 = RCC_CFGR_PPRE_NODIV,
+	.adcpre = RCC_CFGR_ADCPRE_DIV8,
+	.usbpre = RCC_CFGR_USBPRE_PLL_CLK_DIV1_5,
+	.use_hse = true,
+	.pll_hse_prediv = RCC_CFGR2_PREDIV_NODIV,
+	.flash_waitstates = FLASH_ACR_LATENCY_2WS,
+	.ahb_frequency = 64000000,
+	.apb1_frequency = 32000000,
+	.apb2_frequency = 64000000,
+};
+
+/* 8MHz * 13 falls short, 4MHz * 27 hits it. */
+static const struct rcc_clock_scale hse8_108mhz = {
+	.pllmul = RCC_CFGR_PLLMUL_PLL_CLK_MUL27,
+	.hpre = RCC_CFGR_HPRE_NODIV,
+	.ppre1 = RCC_CFGR_PPRE_DIV4,
+	.ppre2 = RCC_CFGR_PPRE_DIV2,
+	.adcpre = RCC_CFGR_ADCPRE_DIV8,
+	.usbpre = RCC_CFGR_USBPRE_PLL_CLK_DIV1_5,
+	.use_hse = true,
+	.pll_hse_prediv = RCC_CFGR2_PREDIV_DIV2,
+	.flash_waitstates = FLASH_ACR_LATENCY_3WS,
+	.ahb_frequency = 108000000,
+	.apb1_frequency = 27000000,
+	.apb2_frequency = 54000000,
+};
+
+static const struct rcc_clock_scale hsi_108mhz = {
+	.pllmul = RCC_CFGR_PLLMUL_PLL_CLK_MUL27,
+	.hpre = RCC_CFGR_HPRE_NODIV,
+	.ppre1 = RCC_CFGR_PPRE_DIV4,
+	.ppre2 = RCC_CFGR_PPRE_DIV2,
+	.adcpre = RCC_CFGR_ADCPRE_DIV8,
+	.use_hse = false,
+	.flash_waitstates = FLASH_ACR_LATENCY_3WS,
+	.ahb_frequency = 108000000,
+	.apb1_frequency = 27000000,
+	.apb2_frequency = 54000000,
+};
+
+/* No multiple of 24MHz at 100MHz, the next one down is 96MHz. */
+static const struct rcc_clock_scale hse8_100mhz_usb = {
+	.pllmul = RCC_CFGR_PLLMUL_PLL_CLK_MUL12,
+	.hpre = RCC_CFGR_HPRE_NODIV,
+	.ppre1 = RCC_CFGR_PPRE_DIV4,
+	.ppre2 = RCC_CFGR_PPRE_DIV2,
+	.adcpre = RCC_CFGR_ADCPRE_DIV8,
+	.usbpre = RCC_CFGR_USBPRE_PLL_CLK_DIV2,
+	.use_hse = true,
+	.pll_hse_prediv = RCC_CFGR2_PREDIV_NODIV,
+	.flash_waitstates = FLASH_ACR_LATENCY_3WS,
+	.ahb_frequency = 96000000,
+	.apb1_frequency = 24000000,
+	.apb2_frequency = 48000000,
+};
+
+static const struct rcc_clock_scale hse12_72mhz_usb = {
+	.pllmul = RCC_CFGR_PLLMUL_PLL_CLK_MUL6,
+	.hpre = RCC_CFGR_HPRE_NODIV,
+	.ppre1 = RCC_CFGR_PPRE_DIV2,
+	.ppre2 = RCC_CFGR_PPRE_NODIV,
+	.adcpre = RCC_CFGR_ADCPRE_DIV8,
+	.usbpre = RCC_CFGR_USBPRE_PLL_CLK_DIV1_5,
+	.use_hse = true,
+	.pll_hse_prediv = RCC_CFGR2_PREDIV_NODIV,
+	.flash_waitstates = FLASH_ACR_LATENCY_2WS,
+	.ahb_frequency = 72000000,
+	.apb1_frequency = 36000000,
+	.apb2_frequency = 72000000,
+};
+
+static const struct pll_case cases[] = {
+	/* The fixed configurations */
+	{ 48 * MHZ, 0, false, &rcc_hsi_configs[RCC_CLOCK_HSI_48MHZ] },
+	{ 64 * MHZ, 0, false, &rcc_hsi_configs[RCC_CLOCK_HSI_64MHZ] },
+	{ 72 * MHZ, 8 * MHZ, true, &rcc_hse8_configs[RCC_CLOCK_HSE8_72MHZ] },
+
+	{ 72 * MHZ, 0, false, &hsi_72mhz },
+	{ 48 * MHZ, 8 * MHZ, false, &hse8_48mhz },
+	{ 48 * MHZ, 8 * MHZ, true, &hse8_48mhz_usb },
+	{ 64 * MHZ, 8 * MHZ, false, &hse8_64mhz },
+	{ 108 * MHZ, 8 * MHZ, false, &hse8_108mhz },
+	{ 108 * MHZ, 0, false, &hsi_108mhz },
+	{ 100 * MHZ, 8 * MHZ, true, &hse8_100mhz_usb },
+	{ 72 * MHZ, 12 * MHZ, true, &hse12_72mhz_usb },
+	/* Rounded down to what the PLL can do */
+	{ 49 * MHZ, 0, false, &rcc_hsi_configs[RCC_CLOCK_HSI_48MHZ] },
+	{ 200 * MHZ, 0, false, &hsi_108mhz },
+
+	/* USB needs the HSE */
+	{ 72 * MHZ, 0, true, NULL },
+	/* No multiple of 24MHz from 25MHz up to 108MHz */
+	{ 108 * MHZ, 25 * MHZ, true, NULL },
+	/* Below the lowest PLL output */
+	{ 7 * MHZ, 0, false, NULL },
+	{ 40 * MHZ, 8 * MHZ, true, NULL },
+};
+
+/* Fields only valid with the HSE are not compared without it. */
+static bool pll_equal(const struct rcc_clock_scale *a,
+		      const struct rcc_clock_scale *b)
+{
+	if (a->use_hse != b->use_hse) {
+		return false;
+	}
+	if (a->use_hse && (a->usbpre != b->usbpre ||
+			   a->pll_hse_prediv != b->pll_hse_prediv)) {
+		return false;
+	}
+	return a->pllmul == b->pllmul && a->hpre == b->hpre &&
+	       a->ppre1 == b->ppre1 && a->ppre2 == b->ppre2 &&
+	       a->adcpre == b->adcpre &&
+	       a->flash_waitstates == b->flash_waitstates &&
+	       a->ahb_frequency == b->ahb_frequency &&
+	       a->apb1_frequency == b->apb1_frequency &&
+	       a->apb2_frequency == b->apb2_frequency;
+}
+
+static void pll_print(const char *what, const struct rcc_clock_scale *c)
+{
+	fprintf(stderr, "  %s: pllmul %#x hpre %#x ppre1 %#x ppre2 %#x "
+		"adcpre %#x usbpre %#x hse %d prediv %#x ws %d "
+		"%u/%u/%u Hz\n", what, c->pllmul, c->hpre, c->ppre1,
+		c->ppre2, c->adcpre, c->usbpre, c->use_hse,
+		c->pll_hse_prediv, c->flash_waitstates,
+		(unsigned)c->ahb_frequency, (unsigned)c->apb1_frequency,
+		(unsigned)c->apb2_frequency);
+}
+
+int main(void)
+{
+	struct rcc_clock_scale clock;
+	unsigned i, failed = 0;
+	bool found;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		const struct pll_case *c = &cases[i];
+
+		found = rcc_clock_compute_pll(c->sysclk, c->hse, c->usb,
+					      &clock);
+		if (found == (c->expected != NULL) &&
+		    (!found || pll_equal(&clock, c->expected))) {
+			continue;
+		}
+
+		fprintf(stderr, "%u Hz from %s %u Hz%s:\n",
+			(unsigned)c->sysclk, c->hse ? "HSE" : "HSI",
+			(unsigned)(c->hse ? c->hse : 8 * MHZ),
+			c->usb ? " with USB" : "");
+		if (found) {
+			pll_print("got", &clock);
+		} else {
+			fprintf(stderr, "  got nothing\n");
+		}
+		if (c->expected) {
+			pll_print("expected", c->expected);
+		} else {
+			fprintf(stderr, "  expected nothing\n");
+		}
+		failed++;
+	}
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,437 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "msc-host.h"
+
+#define EP_IN		0x82
+#define EP_OUT		0x01
+#define EP_SIZE		64
+
+/*-- Stubbed usbd transfer layer ---------------------------------------------*/
+
+struct _usbd_device {
+	int unused;
+};
+
+static struct _usbd_device dev;
+static usbd_set_config_callback set_config;
+static usbd_control_callback control;
+
+/* The transfer queued on each bulk endpoint, if any. */
+struct transfer {
+	bool active;
+	uint8_t *buf;
+	uint32_t len;
+	bool zlp;
+	usbd_transfer_callback callback;
+};
+
+static struct transfer xfer_in, xfer_out;
+
+int usbd_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
+		  uint16_t max_size, usbd_endpoint_callback callback)
+{
+	(void)usbd_dev;
+	(void)addr;
+	(void)type;
+	(void)max_size;
+	(void)callback;
+	return 0;
+}
+
+int usbd_register_control_callback(usbd_device *usbd_dev, uint8_t type,
+				   uint8_t type_mask,
+				   usbd_control_callback callback)
+{
+	(void)usbd_dev;
+	(void)type;
+	(void)type_mask;
+	control = callback;
+	return 0;
+}
+
+int usbd_register_set_config_callback(usbd_device *usbd_dev,
+				      usbd_set_config_callback callback)
+{
+	(void)usbd_dev;
+	set_config = callback;
+	return 0;
+}
+
+int usbd_ep_transfer(usbd_device *usbd_dev, uint8_t addr, void *buf,
+		     uint32_t len, bool zlp, usbd_transfer_callback callback)
+{
+	struct transfer *t = (addr & 0x80) ? &xfer_in : &xfer_out;
+
+	CHECK(usbd_dev == &dev);
+	CHECK(addr == EP_IN || addr == EP_OUT);
+	if (t->active) {
+		return -1;
+	}
+	t->active = true;
+	t->buf = buf;
+	t->len = len;
+	t->zlp = zlp;
+	t->callback = callback;
+	return 0;
+}
+
+void usbd_ep_transfer_cancel(usbd_device *usbd_dev, uint8_t addr)
+{
+	(void)usbd_dev;
+	((addr & 0x80) ? &xfer_in : &xfer_out)->active = false;
+}
+
+/*-- RAM disk ----------------------------------------------------------------*/
+
+uint8_t disk[DISK_BLOCKS][BLOCK_SIZE];
+struct disk_stats disk_stats;
+uint32_t disk_fail_lba = DISK_FAIL_NONE;
+int disk_fail_status;
+
+static uint32_t disk_blocks;
+static usbd_mass_storage *async_ms;
+
+static struct {
+	bool pending;
+	bool write;
+	uint32_t lba;
+	uint8_t *to;
+	const uint8_t *from;
+	uint32_t count;
+} async;
+
+uint8_t disk_pattern(uint32_t lba, uint32_t i)
+{
+	return (lba * 7 + i * 13 + (lba >> 8)) & 0xff;
+}
+
+void disk_fill(void)
+{
+	uint32_t lba, i;
+
+	for (lba = 0; lba < DISK_BLOCKS; lba++) {
+		for (i = 0; i < BLOCK_SIZE; i++) {
+			disk[lba][i] = disk_pattern(lba, i);
+		}
+	}
+}
+
+/* A device may claim more blocks than the RAM disk has, to test limits. */
+static int disk_check(uint32_t lba, uint32_t count)
+{
+	if (lba >= disk_blocks || count > disk_blocks - lba ||
+	    lba >= DISK_BLOCKS || count > DISK_BLOCKS - lba) {
+		return USB_MSC_MEDIA_OUT_OF_RANGE;
+	}
+	if (disk_fail_lba == DISK_FAIL_ALL ||
+	    (disk_fail_lba >= lba && disk_fail_lba - lba < count)) {
+		return disk_fail_status;
+	}
+	return USB_MSC_MEDIA_OK;
+}
+
+static int disk_read_blocks(uint32_t lba, uint8_t *to, uint32_t count)
+{
+	int status = disk_check(lba, count);
+
+	disk_stats.reads++;
+	if (!status) {
+		memcpy(to, disk[lba], count * BLOCK_SIZE);
+	}
+	return status;
+}
+
+/* NOR flash: every erase block touched is erased and written again. */
+static int disk_write_blocks(uint32_t lba, const uint8_t *from, uint32_t count)
+{
+	int status = disk_check(lba, count);
+
+	disk_stats.writes++;
+	if (!status) {
+		memcpy(disk[lba], from, count * BLOCK_SIZE);
+		disk_stats.erases += (lba + count - 1) / ERASE_BLOCKS -
+				     lba / ERASE_BLOCKS + 1;
+	}
+	return status;
+}
+
+static int disk_read_block(uint32_t lba, uint8_t *to)
+{
+	return disk_read_blocks(lba, to, 1);
+}
+
+static int disk_write_block(uint32_t lba, const uint8_t *from)
+{
+	return disk_write_blocks(lba, from, 1);
+}
+
+static void disk_start_read(uint32_t lba, uint8_t *to, uint32_t count)
+{
+	CHECK(!async.pending);
+	async.pending = true;
+	async.write = false;
+	async.lba = lba;
+	async.to = to;
+	async.count = count;
+}
+
+static void disk_start_write(uint32_t lba, const uint8_t *from,
+			     uint32_t count)
+{
+	CHECK(!async.pending);
+	async.pending = true;
+	async.write = true;
+	async.lba = lba;
+	async.from = from;
+	async.count = count;
+}
+
+void disk_async(usbd_mass_storage *ms)
+{
+	async_ms = ms;
+	usb_msc_set_async_callbacks(ms, disk_start_read, disk_start_write);
+}
+
+bool disk_async_pending(void)
+{
+	return async.pending;
+}
+
+void disk_async_done(void)
+{
+	int status;
+
+	CHECK(async.pending);
+	async.pending = false;
+	if (async.write) {
+		status = disk_write_blocks(async.lba, async.from, async.count);
+	} else {
+		status = disk_read_blocks(async.lba, async.to, async.count);
+	}
+	usb_msc_media_done(async_ms, status);
+}
+
+static usbd_mass_storage *msc_init(uint32_t blocks, bool blocking)
+{
+	usbd_mass_storage *ms;
+
+	memset(&xfer_in, 0, sizeof(xfer_in));
+	memset(&xfer_out, 0, sizeof(xfer_out));
+	memset(&async, 0, sizeof(async));
+	memset(&disk_stats, 0, sizeof(disk_stats));
+	disk_fail_lba = DISK_FAIL_NONE;
+	disk_blocks = blocks;
+	disk_fill();
+
+	ms = usb_msc_init(&dev, EP_IN, EP_SIZE, EP_OUT, EP_SIZE,
+			  "VENDOR", "PRODUCT", "0.1", blocks,
+			  blocking ? disk_read_block : NULL,
+			  blocking ? disk_write_block : NULL);
+	return ms;
+}
+
+static void msc_configure(void)
+{
+	CHECK(set_config);
+	set_config(&dev, 1);
+}
+
+usbd_mass_storage *msc_setup(uint32_t blocks, bool multi)
+{
+	usbd_mass_storage *ms = msc_init(blocks, true);
+
+	if (multi) {
+		usb_msc_set_block_callbacks(ms, disk_read_blocks,
+					    disk_write_blocks);
+	}
+	msc_configure();
+	return ms;
+}
+
+usbd_mass_storage *msc_setup_async(uint32_t blocks)
+{
+	usbd_mass_storage *ms = msc_init(blocks, false);
+
+	disk_async(ms);
+	msc_configure();
+	return ms;
+}
+
+/*-- Bulk-Only host ----------------------------------------------------------*/
+
+/*
+ * The endpoint NAKs: only a media operation still running can make
+ * progress, anything else is a device that hangs.
+ */
+static void msc_nak(const char *ep)
+{
+	if (!async.pending) {
+		fprintf(stderr, "device hangs, nothing queued on %s\n", ep);
+		exit(1);
+	}
+	disk_async_done();
+}
+
+bool msc_in_queued(void)
+{
+	return xfer_in.active;
+}
+
+bool msc_out_queued(void)
+{
+	return xfer_out.active;
+}
+
+uint32_t msc_in(void *buf, uint32_t max)
+{
+	uint32_t len;
+
+	while (!xfer_in.active) {
+		msc_nak("IN");
+	}
+	len = xfer_in.len;
+	CHECK(len <= max);
+	memcpy(buf, xfer_in.buf, len);
+	xfer_in.active = false;
+	xfer_in.callback(&dev, EP_IN, len);
+	return len;
+}
+
+/* Transfers until len bytes or a short one, which ends the data phase. */
+uint32_t msc_in_all(void *buf, uint32_t len)
+{
+	uint8_t *p = buf;
+	uint32_t done = 0, n;
+
+	do {
+		n = msc_in(p + done, len - done);
+		done += n;
+	} while (done < len && n && !(n % EP_SIZE));
+	return done;
+}
+
+void msc_out(const void *buf, uint32_t len)
+{
+	while (!xfer_out.active) {
+		msc_nak("OUT");
+	}
+	CHECK(len <= xfer_out.len);
+	memcpy(xfer_out.buf, buf, len);
+	xfer_out.active = false;
+	xfer_out.callback(&dev, EP_OUT, len);
+}
+
+void msc_out_all(const void *buf, uint32_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t n;
+
+	while (len) {
+		while (!xfer_out.active) {
+			msc_nak("OUT");
+		}
+		n = len < xfer_out.len ? len : xfer_out.len;
+		msc_out(p, n);
+		p += n;
+		len -= n;
+	}
+}
+
+void msc_cbw(uint32_t tag, uint32_t len, bool in, const uint8_t *cdb,
+	     uint8_t cdb_len)
+{
+	uint8_t cbw[31] = { 'U', 'S', 'B', 'C' };
+
+	memcpy(&cbw[4], &tag, 4);
+	memcpy(&cbw[8], &len, 4);
+	cbw[12] = in ? 0x80 : 0;
+	cbw[14] = cdb_len;
+	memcpy(&cbw[15], cdb, cdb_len);
+	msc_out(cbw, sizeof(cbw));
+}
+
+void msc_csw(uint32_t tag, uint8_t status, uint32_t residue)
+{
+	uint8_t csw[13];
+	uint32_t csw_tag, csw_residue;
+
+	CHECK(msc_in(csw, sizeof(csw)) == sizeof(csw));
+	memcpy(&csw_tag, &csw[4], 4);
+	memcpy(&csw_residue, &csw[8], 4);
+	if (memcmp(csw, "USBS", 4) || csw_tag != tag ||
+	    csw[12] != status || csw_residue != residue) {
+		fprintf(stderr, "CSW tag %u status %u residue %u, "
+			"expected %u %u %u\n", csw_tag, csw[12], csw_residue,
+			tag, status, residue);
+		exit(1);
+	}
+}
+
+void msc_reset(void)
+{
+	struct usb_setup_data req = {
+		.bmRequestType = USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE,
+		.bRequest = USB_MSC_REQ_BULK_ONLY_RESET,
+	};
+	uint8_t data[8];
+	uint8_t *buf = data;
+	uint16_t len = 0;
+
+	CHECK(control(&dev, &req, &buf, &len, NULL) == USBD_REQ_HANDLED);
+}
+
+void msc_sense(uint32_t tag, uint8_t key, uint8_t asc, uint8_t ascq)
+{
+	uint8_t cdb[6] = { 0x03, 0, 0, 0, 18, 0 };
+	uint8_t sense[18];
+
+	msc_cbw(tag, sizeof(sense), true, cdb, sizeof(cdb));
+	CHECK(msc_in_all(sense, sizeof(sense)) == sizeof(sense));
+	msc_csw(tag, CSW_PASSED, 0);
+	if ((sense[2] & 0x0f) != key || sense[12] != asc ||
+	    sense[13] != ascq) {
+		fprintf(stderr, "sense %02x/%02x/%02x, expected "
+			"%02x/%02x/%02x\n", sense[2] & 0x0f, sense[12],
+			sense[13], key, asc, ascq);
+		exit(1);
+	}
+}
+
+void msc_read10(uint32_t tag, uint32_t lba, uint16_t count, void *buf)
+{
+	uint8_t cdb[10] = { 0x28, 0, lba >> 24, lba >> 16, lba >> 8, lba,
+			    0, count >> 8, count, 0 };
+	uint32_t len = count * BLOCK_SIZE;
+
+	msc_cbw(tag, len, true, cdb, sizeof(cdb));
+	CHECK(msc_in_all(buf, len) == len);
+	msc_csw(tag, CSW_PASSED, 0);
+}
+
+void msc_write10(uint32_t tag, uint32_t lba, uint16_t count,
+		 const void *buf)
+{
+	uint8_t cdb[10] = { 0x2a, 0, lba >> 24, lba >> 16, lba >> 8, lba,
+			    0, count >> 8, count, 0 };
+	uint32_t len = count * BLOCK_SIZE;
+
+	msc_cbw(tag, len, false, cdb, sizeof(cdb));
+	msc_out_all(buf, len);
+	msc_csw(tag, CSW_PASSED, 0);
+}
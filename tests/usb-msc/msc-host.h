@@ -0,0 +1,110 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host side of the usb_msc tests: usb_msc.c runs on top of a stubbed usbd
+ * transfer layer, the test plays the Bulk-Only host against it and the
+ * media is a RAM disk that counts backend calls.
+ */
+
+#ifndef MSC_HOST_H
+#define MSC_HOST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/msc.h>
+
+#define CHECK(x)							\
+	do {								\
+		if (!(x)) {						\
+			fprintf(stderr, "%s:%d: check failed: %s\n",	\
+				__FILE__, __LINE__, #x);		\
+			exit(1);					\
+		}							\
+	} while (0)
+
+#define BLOCK_SIZE		512
+#define DISK_BLOCKS		4096
+#define ERASE_BLOCKS		8	/* 4 KiB erase blocks of SPI NOR */
+
+#define CSW_PASSED		0
+#define CSW_FAILED		1
+#define CSW_PHASE_ERROR		2
+
+extern uint8_t disk[DISK_BLOCKS][BLOCK_SIZE];
+
+struct disk_stats {
+	unsigned reads;		/* Backend read calls */
+	unsigned writes;	/* Backend write calls */
+	unsigned erases;	/* Erase blocks rewritten by those writes */
+};
+extern struct disk_stats disk_stats;
+
+/*
+ * A backend call touching block fail_lba fails with fail_status, or
+ * every call while fail_lba is DISK_FAIL_ALL.
+ */
+#define DISK_FAIL_NONE		0xffffffff
+#define DISK_FAIL_ALL		0xfffffffe
+extern uint32_t disk_fail_lba;
+extern int disk_fail_status;
+
+/* Fill the disk with a pattern that differs in every byte of a block. */
+void disk_fill(void);
+uint8_t disk_pattern(uint32_t lba, uint32_t i);
+
+/*
+ * A device with blocks blocks on the RAM disk, configured. The backend
+ * takes one block per call; several per call with multi.
+ */
+usbd_mass_storage *msc_setup(uint32_t blocks, bool multi);
+
+/* The same with only the asynchronous callbacks, see disk_async(). */
+usbd_mass_storage *msc_setup_async(uint32_t blocks);
+
+/*
+ * Use start_read/start_write. The operation only completes when the host
+ * has nothing else to do, or by disk_async_done().
+ */
+void disk_async(usbd_mass_storage *ms);
+bool disk_async_pending(void);
+void disk_async_done(void);
+
+/* Bulk-Only host. */
+void msc_cbw(uint32_t tag, uint32_t len, bool in, const uint8_t *cdb,
+	     uint8_t cdb_len);
+uint32_t msc_in(void *buf, uint32_t max);
+uint32_t msc_in_all(void *buf, uint32_t len);
+void msc_out(const void *buf, uint32_t len);
+void msc_out_all(const void *buf, uint32_t len);
+void msc_csw(uint32_t tag, uint8_t status, uint32_t residue);
+void msc_reset(void);
+bool msc_in_queued(void);
+bool msc_out_queued(void);
+
+/* Sense key, ASC and ASCQ from REQUEST SENSE. */
+void msc_sense(uint32_t tag, uint8_t key, uint8_t asc, uint8_t ascq);
+
+/* READ(10) and WRITE(10) of count blocks, status GOOD. */
+void msc_read10(uint32_t tag, uint32_t lba, uint16_t count, void *buf);
+void msc_write10(uint32_t tag, uint32_t lba, uint16_t count,
+		 const void *buf);
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Asynchronous backend, media errors and resets. */
+
+#include <string.h>
+#include "msc-host.h"
+
+/* Sense keys and codes, (SPC-3) 4.5.6 */
+#define NOT_READY		0x02
+#define MEDIUM_ERROR		0x03
+#define ILLEGAL_REQUEST		0x05
+#define DATA_PROTECT		0x07
+#define ASC_READ_ERROR		0x11
+#define ASC_INVALID_OPCODE	0x20
+#define ASC_WRITE_PROTECTED	0x27
+#define ASC_NOT_PRESENT		0x3a
+
+static uint8_t data[128 * BLOCK_SIZE];
+static const uint8_t tur[6];
+
+static void check_disk(uint32_t lba, uint32_t count, const uint8_t *buf)
+{
+	CHECK(!memcmp(disk[lba], buf, count * BLOCK_SIZE));
+}
+
+/* The endpoints NAK until the backend is done. */
+static void test_async_read_write(void)
+{
+	uint8_t cdb[10] = { 0x28, 0, 0, 0, 0, 4, 0, 0, 3, 0 };
+
+	msc_setup_async(64);
+	msc_cbw(1, 3 * BLOCK_SIZE, true, cdb, sizeof(cdb));
+	CHECK(disk_async_pending());
+	CHECK(!msc_in_queued());
+	disk_async_done();
+	CHECK(msc_in_queued());
+	CHECK(msc_in_all(data, 3 * BLOCK_SIZE) == 3 * BLOCK_SIZE);
+	msc_csw(1, CSW_PASSED, 0);
+	check_disk(4, 3, data);
+
+	memset(data, 0x5a, 3 * BLOCK_SIZE);
+	cdb[0] = 0x2a;
+	msc_cbw(2, 3 * BLOCK_SIZE, false, cdb, sizeof(cdb));
+	msc_out(data, BLOCK_SIZE);
+	CHECK(disk_async_pending());
+	msc_out(data + BLOCK_SIZE, BLOCK_SIZE);
+	/* Both buffers full, the host waits for the media. */
+	CHECK(!msc_out_queued());
+	msc_out_all(data + 2 * BLOCK_SIZE, BLOCK_SIZE);
+	msc_csw(2, CSW_PASSED, 0);
+	check_disk(4, 3, data);
+}
+
+/*
+ * A reset in the middle of a media operation: the next command waits for
+ * it, so it can't land in the buffer the next command answers from.
+ */
+static void test_stale_reset(void)
+{
+	uint8_t cdb[10] = { 0x28, 0, 0, 0, 0, 8, 0, 0, 4, 0 };
+	uint8_t inquiry[6] = { 0x12, 0, 0, 0, 36, 0 };
+	uint8_t buf[36];
+
+	msc_setup_async(64);
+	msc_cbw(1, 4 * BLOCK_SIZE, true, cdb, sizeof(cdb));
+	CHECK(disk_async_pending());
+	msc_reset();
+	CHECK(!msc_in_queued());
+	CHECK(!msc_out_queued());
+
+	disk_async_done();
+	CHECK(!disk_async_pending());
+	CHECK(msc_out_queued());
+
+	msc_cbw(2, sizeof(buf), true, inquiry, sizeof(inquiry));
+	CHECK(msc_in_all(buf, sizeof(buf)) == sizeof(buf));
+	CHECK(!memcmp(&buf[8], "VENDOR  PRODUCT         0.1 ", 28));
+	msc_csw(2, CSW_PASSED, 0);
+
+	msc_read10(3, 8, 4, data);
+	check_disk(8, 4, data);
+}
+
+/* Blocks before a read error go out, nothing is read after it. */
+static void test_read_error(bool async)
+{
+	uint8_t cdb[10] = { 0x28, 0, 0, 0, 0, 10, 0, 0, 6, 0 };
+
+	if (async) {
+		msc_setup_async(64);
+	} else {
+		msc_setup(64, false);
+	}
+	disk_fail_lba = 12;
+	disk_fail_status = USB_MSC_MEDIA_ERROR;
+
+	msc_cbw(1, 6 * BLOCK_SIZE, true, cdb, sizeof(cdb));
+	CHECK(msc_in_all(data, 6 * BLOCK_SIZE) == 2 * BLOCK_SIZE);
+	msc_csw(1, CSW_FAILED, 4 * BLOCK_SIZE);
+	check_disk(10, 2, data);
+	CHECK(disk_stats.reads == 3);
+	msc_sense(2, MEDIUM_ERROR, ASC_READ_ERROR, 0);
+}
+
+/* An absent card fails at the first block, not at every one. */
+static void test_not_present(void)
+{
+	uint8_t cdb[10] = { 0x28, 0, 0, 0, 0, 0, 0, 0, 100, 0 };
+
+	msc_setup(128, false);
+	disk_fail_lba = DISK_FAIL_ALL;
+	disk_fail_status = USB_MSC_MEDIA_NOT_PRESENT;
+
+	msc_cbw(1, 100 * BLOCK_SIZE, true, cdb, sizeof(cdb));
+	CHECK(msc_in_all(data, 100 * BLOCK_SIZE) == 0);
+	msc_csw(1, CSW_FAILED, 100 * BLOCK_SIZE);
+	CHECK(disk_stats.reads == 1);
+	msc_sense(2, NOT_READY, ASC_NOT_PRESENT, 0);
+
+	disk_fail_lba = DISK_FAIL_NONE;
+	msc_cbw(3, 0, false, tur, sizeof(tur));
+	msc_csw(3, CSW_PASSED, 0);
+}
+
+/* The host still sends all of its data, none of it is written. */
+static void test_write_protected(bool async)
+{
+	uint8_t cdb[10] = { 0x2a, 0, 0, 0, 0, 16, 0, 0, 8, 0 };
+
+	if (async) {
+		msc_setup_async(64);
+	} else {
+		msc_setup(64, false);
+	}
+	disk_fail_lba = DISK_FAIL_ALL;
+	disk_fail_status = USB_MSC_MEDIA_WRITE_PROTECTED;
+
+	memset(data, 0xa5, 8 * BLOCK_SIZE);
+	msc_cbw(1, 8 * BLOCK_SIZE, false, cdb, sizeof(cdb));
+	msc_out_all(data, 8 * BLOCK_SIZE);
+	msc_csw(1, CSW_FAILED, 8 * BLOCK_SIZE);
+	CHECK(disk_stats.writes == 1);
+	CHECK(disk[16][0] == disk_pattern(16, 0));
+	msc_sense(2, DATA_PROTECT, ASC_WRITE_PROTECTED, 0);
+}
+
+/* Blocks written before the error count, the rest is residue. */
+static void test_write_error(void)
+{
+	uint8_t cdb[10] = { 0x2a, 0, 0, 0, 0, 16, 0, 0, 8, 0 };
+
+	msc_setup(64, false);
+	disk_fail_lba = 19;
+	disk_fail_status = USB_MSC_MEDIA_ERROR;
+
+	memset(data, 0xa5, 8 * BLOCK_SIZE);
+	msc_cbw(1, 8 * BLOCK_SIZE, false, cdb, sizeof(cdb));
+	msc_out_all(data, 8 * BLOCK_SIZE);
+	msc_csw(1, CSW_FAILED, 5 * BLOCK_SIZE);
+	CHECK(disk_stats.writes == 4);
+	check_disk(16, 3, data);
+	CHECK(disk[20][0] == disk_pattern(20, 0));
+}
+
+static void test_format_unit(void)
+{
+	uint8_t cdb[6] = { 0x04, 0, 0, 0, 0, 0 };
+	uint32_t lba;
+
+	msc_setup(64, false);
+	msc_cbw(1, 0, false, cdb, sizeof(cdb));
+	msc_csw(1, CSW_PASSED, 0);
+	for (lba = 0; lba < 64; lba++) {
+		CHECK(!disk[lba][0] && !disk[lba][BLOCK_SIZE - 1]);
+	}
+
+	/* Not without a blocking write. */
+	msc_setup_async(64);
+	msc_cbw(2, 0, false, cdb, sizeof(cdb));
+	msc_csw(2, CSW_FAILED, 0);
+	CHECK(!disk_stats.writes);
+	msc_sense(3, ILLEGAL_REQUEST, ASC_INVALID_OPCODE, 0);
+}
+
+int main(void)
+{
+	test_async_read_write();
+	test_stale_reset();
+	test_read_error(false);
+	test_read_error(true);
+	test_not_present();
+	test_write_protected(false);
+	test_write_protected(true);
+	test_write_error();
+	test_format_unit();
+	return 0;
+}
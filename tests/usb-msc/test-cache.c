@@ -0,0 +1,181 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Write-back cache of one erase block, counted in backend erases. */
+
+#include <string.h>
+#include "msc-host.h"
+
+#define MEDIA_BLOCKS		2048
+
+static uint8_t cache[ERASE_BLOCKS * BLOCK_SIZE] __attribute__((aligned(4)));
+static uint8_t image[MEDIA_BLOCKS][BLOCK_SIZE];
+static uint8_t data[128 * BLOCK_SIZE];
+static uint32_t tag;
+
+/*
+ * A host copying a 256 KiB file onto a FAT16 volume: 1 reserved block,
+ * two FATs of 32 blocks, 32 blocks of root directory, then clusters of 4
+ * blocks from block 97 on. The data goes out 64 KiB per command.
+ */
+struct trace_write {
+	uint32_t lba;
+	uint16_t count;
+};
+
+static const struct trace_write fat_copy[] = {
+	{ 1, 1 },	/* Cluster chain, first FAT */
+	{ 33, 1 },	/* and second FAT */
+	{ 65, 1 },	/* Directory entry */
+	{ 97, 128 },	/* File data */
+	{ 225, 128 },
+	{ 353, 128 },
+	{ 481, 128 },
+	{ 1, 1 },	/* End of chain */
+	{ 33, 1 },
+	{ 65, 1 },	/* File size */
+};
+
+#define FAT_COPY_BLOCKS		518
+
+static void command(uint8_t opcode, uint8_t cdb_len)
+{
+	uint8_t cdb[10] = { opcode };
+
+	msc_cbw(++tag, 0, false, cdb, cdb_len);
+	msc_csw(tag, CSW_PASSED, 0);
+}
+
+static void replay(const struct trace_write *trace, unsigned n)
+{
+	unsigned i;
+	uint32_t j;
+
+	memcpy(image, disk, sizeof(image));
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < trace[i].count * BLOCK_SIZE; j++) {
+			data[j] = i * 37 + j * 11;
+		}
+		memcpy(image[trace[i].lba], data, trace[i].count * BLOCK_SIZE);
+		msc_write10(++tag, trace[i].lba, trace[i].count, data);
+	}
+}
+
+static unsigned fat_copy_erases(bool cached)
+{
+	usbd_mass_storage *ms = msc_setup(MEDIA_BLOCKS, true);
+
+	if (cached) {
+		CHECK(!usb_msc_set_write_cache(ms, cache, sizeof(cache), 0));
+	}
+	replay(fat_copy, sizeof(fat_copy) / sizeof(fat_copy[0]));
+	command(0x35, 10);	/* SYNCHRONIZE CACHE */
+	CHECK(!memcmp(image, disk, sizeof(image)));
+	return disk_stats.erases;
+}
+
+/*
+ * Every 512 byte block costs an erase without the cache. With it, each
+ * erase block is written once per visit of the trace: 3 for FAT and
+ * directory, 65 for the data from block 97 to 608, 3 more at the end.
+ */
+static void test_fat_copy(void)
+{
+	unsigned direct = fat_copy_erases(false);
+	unsigned cached = fat_copy_erases(true);
+
+	printf("  FAT copy: %u erases direct, %u cached\n", direct, cached);
+	CHECK(direct == FAT_COPY_BLOCKS);
+	CHECK(cached == 71);
+	CHECK(cached * 7 < direct);
+}
+
+/* Reads see blocks that are only in the cache. */
+static void test_read_cached(void)
+{
+	usbd_mass_storage *ms = msc_setup(MEDIA_BLOCKS, true);
+	static uint8_t back[4 * BLOCK_SIZE];
+
+	CHECK(!usb_msc_set_write_cache(ms, cache, sizeof(cache), 0));
+	memset(data, 0x3c, 2 * BLOCK_SIZE);
+	msc_write10(++tag, 6, 2, data);
+	CHECK(!disk_stats.writes);
+
+	/* Straddles the cached erase block and the next one. */
+	msc_read10(++tag, 6, 4, back);
+	CHECK(!memcmp(back, data, 2 * BLOCK_SIZE));
+	CHECK(!memcmp(back + 2 * BLOCK_SIZE, disk[8], 2 * BLOCK_SIZE));
+	CHECK(disk[6][0] == disk_pattern(6, 0));
+}
+
+/* Written back after timeout idle ticks, and on START STOP UNIT. */
+static void test_write_back(void)
+{
+	usbd_mass_storage *ms = msc_setup(MEDIA_BLOCKS, true);
+	int i;
+
+	CHECK(!usb_msc_set_write_cache(ms, cache, sizeof(cache), 5));
+	memset(data, 0x11, BLOCK_SIZE);
+	msc_write10(++tag, 42, 1, data);
+	for (i = 0; i < 4; i++) {
+		usb_msc_cache_tick(ms);
+	}
+	CHECK(!disk_stats.erases);
+	usb_msc_cache_tick(ms);
+	CHECK(disk_stats.erases == 1);
+	CHECK(!memcmp(disk[42], data, BLOCK_SIZE));
+	/* The rest of the erase block was read back and kept. */
+	CHECK(disk[40][0] == disk_pattern(40, 0));
+	CHECK(disk[47][1] == disk_pattern(47, 1));
+
+	/* Nothing left to write. */
+	for (i = 0; i < 10; i++) {
+		usb_msc_cache_tick(ms);
+	}
+	CHECK(disk_stats.erases == 1);
+
+	memset(data, 0x22, BLOCK_SIZE);
+	msc_write10(++tag, 43, 1, data);
+	command(0x1b, 6);	/* START STOP UNIT */
+	CHECK(disk_stats.erases == 2);
+	CHECK(!memcmp(disk[43], data, BLOCK_SIZE));
+
+	CHECK(!usb_msc_cache_flush(ms));
+	CHECK(disk_stats.erases == 2);
+}
+
+/* The last erase block may be cut short by the end of the media. */
+static void test_media_end(void)
+{
+	usbd_mass_storage *ms = msc_setup(MEDIA_BLOCKS - 3, true);
+
+	CHECK(!usb_msc_set_write_cache(ms, cache, sizeof(cache), 0));
+	memset(data, 0x77, BLOCK_SIZE);
+	msc_write10(++tag, MEDIA_BLOCKS - 4, 1, data);
+	CHECK(!usb_msc_cache_flush(ms));
+	CHECK(disk_stats.writes == 1);
+	CHECK(!memcmp(disk[MEDIA_BLOCKS - 4], data, BLOCK_SIZE));
+}
+
+int main(void)
+{
+	test_fat_copy();
+	test_read_cached();
+	test_write_back();
+	test_media_end();
+	return 0;
+}
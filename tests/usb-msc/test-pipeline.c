@@ -0,0 +1,114 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Block data through the two buffers of the pipeline. */
+
+#include <string.h>
+#include "msc-host.h"
+
+static uint8_t data[64 * BLOCK_SIZE];
+static uint8_t big_buf[2][4 * BLOCK_SIZE] __attribute__((aligned(4)));
+
+static void check_disk(uint32_t lba, uint32_t count, const uint8_t *buf)
+{
+	CHECK(!memcmp(disk[lba], buf, count * BLOCK_SIZE));
+}
+
+static void fill(uint8_t *buf, uint32_t len, uint8_t seed)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = seed + i * 31;
+	}
+}
+
+/* The next block is read while the first one goes out. */
+static void test_read_ahead(void)
+{
+	uint8_t cdb[10] = { 0x28, 0, 0, 0, 0, 3, 0, 0, 9, 0 };
+	uint32_t lba;
+
+	msc_setup(64, false);
+	msc_cbw(1, 9 * BLOCK_SIZE, true, cdb, sizeof(cdb));
+	CHECK(disk_stats.reads == 2);
+	CHECK(msc_in_all(data, 9 * BLOCK_SIZE) == 9 * BLOCK_SIZE);
+	msc_csw(1, CSW_PASSED, 0);
+	CHECK(disk_stats.reads == 9);
+	for (lba = 3; lba < 12; lba++) {
+		CHECK(!memcmp(data + (lba - 3) * BLOCK_SIZE, disk[lba],
+			      BLOCK_SIZE));
+	}
+}
+
+static void test_write(void)
+{
+	msc_setup(64, false);
+	fill(data, 7 * BLOCK_SIZE, 5);
+	msc_write10(1, 10, 7, data);
+	check_disk(10, 7, data);
+	CHECK(disk_stats.writes == 7);
+
+	/* Neighbours untouched. */
+	CHECK(disk[9][0] == disk_pattern(9, 0));
+	CHECK(disk[17][0] == disk_pattern(17, 0));
+}
+
+/* Larger buffers take several blocks per backend call. */
+static void test_multi(void)
+{
+	usbd_mass_storage *ms = msc_setup(64, true);
+
+	CHECK(usb_msc_set_buffer(ms, big_buf[0], BLOCK_SIZE) == -1);
+	CHECK(!usb_msc_set_buffer(ms, big_buf[0], sizeof(big_buf)));
+
+	msc_read10(1, 5, 9, data);
+	CHECK(disk_stats.reads == 3);
+	check_disk(5, 9, data);
+
+	fill(data, 10 * BLOCK_SIZE, 77);
+	msc_write10(2, 20, 10, data);
+	CHECK(disk_stats.writes == 3);
+	check_disk(20, 10, data);
+
+	/* The last block of the media. */
+	msc_read10(3, 63, 1, data);
+	check_disk(63, 1, data);
+}
+
+/* A block buffer is reused between commands without leaking data. */
+static void test_back_to_back(void)
+{
+	uint32_t i;
+
+	msc_setup(64, false);
+	for (i = 0; i < 8; i++) {
+		fill(data, 3 * BLOCK_SIZE, i);
+		msc_write10(2 * i, 8 * i, 3, data);
+		msc_read10(2 * i + 1, 8 * i, 3, data + 3 * BLOCK_SIZE);
+		CHECK(!memcmp(data, data + 3 * BLOCK_SIZE, 3 * BLOCK_SIZE));
+	}
+}
+
+int main(void)
+{
+	test_read_ahead();
+	test_write();
+	test_multi();
+	test_back_to_back();
+	return 0;
+}
@@ -0,0 +1,273 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* SCSI commands and the thirteen cases of (A) 6.7. */
+
+#include <string.h>
+#include "msc-host.h"
+
+#define ILLEGAL_REQUEST		0x05
+#define ASC_INVALID_OPCODE	0x20
+#define ASC_LBA_OUT_OF_RANGE	0x21
+#define ASC_INVALID_FIELD	0x24
+
+static uint8_t data[16 * BLOCK_SIZE];
+static uint8_t cache[ERASE_BLOCKS * BLOCK_SIZE] __attribute__((aligned(4)));
+static const uint8_t tur[6];
+static const uint8_t read1[10] = { 0x28, 0, 0, 0, 0, 2, 0, 0, 1, 0 };
+static const uint8_t read2[10] = { 0x28, 0, 0, 0, 0, 2, 0, 0, 2, 0 };
+static const uint8_t read4[10] = { 0x28, 0, 0, 0, 0, 2, 0, 0, 4, 0 };
+static const uint8_t write1[10] = { 0x2a, 0, 0, 0, 0, 2, 0, 0, 1, 0 };
+static const uint8_t write2[10] = { 0x2a, 0, 0, 0, 0, 2, 0, 0, 2, 0 };
+
+static void test_inquiry(void)
+{
+	uint8_t cdb[6] = { 0x12, 0, 0, 0, 96, 0 };
+
+	msc_setup(64, false);
+	msc_cbw(1, 96, true, cdb, sizeof(cdb));
+	CHECK(msc_in_all(data, 96) == 36);
+	CHECK(!memcmp(&data[8], "VENDOR  ", 8));
+	msc_csw(1, CSW_PASSED, 60);
+}
+
+static void test_capacity(void)
+{
+	uint8_t rc[10] = { 0x25 };
+	uint8_t rfc[10] = { 0x23, 0, 0, 0, 0, 0, 0, 0, 252, 0 };
+
+	msc_setup(64, false);
+	msc_cbw(1, 8, true, rc, sizeof(rc));
+	CHECK(msc_in_all(data, 8) == 8);
+	CHECK(data[3] == 63 && data[6] == 2);
+	msc_csw(1, CSW_PASSED, 0);
+
+	/* One formatted media descriptor. */
+	msc_cbw(2, 252, true, rfc, sizeof(rfc));
+	CHECK(msc_in_all(data, 252) == 12);
+	CHECK(data[3] == 8 && data[7] == 64 && data[8] == 2 && data[10] == 2);
+	msc_csw(2, CSW_PASSED, 240);
+}
+
+/* The caching page reports the write cache. */
+static void test_mode_sense(void)
+{
+	uint8_t ms10[10] = { 0x5a, 0, 0x08, 0, 0, 0, 0, 0, 64, 0 };
+	uint8_t ms6[6] = { 0x1a, 0, 0x3f, 0, 255, 0 };
+	usbd_mass_storage *ms = msc_setup(64, false);
+
+	msc_cbw(1, 64, true, ms10, sizeof(ms10));
+	CHECK(msc_in_all(data, 64) == 28);
+	CHECK(data[1] == 26 && data[8] == 0x08 && !(data[10] & 0x04));
+	msc_csw(1, CSW_PASSED, 36);
+
+	CHECK(!usb_msc_set_write_cache(ms, cache, sizeof(cache), 0));
+	msc_cbw(2, 64, true, ms10, sizeof(ms10));
+	CHECK(msc_in_all(data, 64) == 28);
+	CHECK(data[10] & 0x04);
+	msc_csw(2, CSW_PASSED, 36);
+
+	/* All pages. */
+	msc_cbw(3, 255, true, ms6, sizeof(ms6));
+	CHECK(msc_in_all(data, 255) == 36);
+	CHECK(data[0] == 35);
+	msc_csw(3, CSW_PASSED, 255 - 36);
+
+	/* A page that does not exist. */
+	ms6[2] = 0x22;
+	msc_cbw(4, 255, true, ms6, sizeof(ms6));
+	CHECK(msc_in_all(data, 255) == 0);
+	msc_csw(4, CSW_FAILED, 255);
+	msc_sense(5, ILLEGAL_REQUEST, ASC_INVALID_FIELD, 0);
+}
+
+/* Only the range is checked, no data phase. */
+static void test_verify(void)
+{
+	uint8_t cdb[10] = { 0x2f, 0, 0, 0, 0, 1, 0, 0, 4, 0 };
+
+	msc_setup(64, false);
+	msc_cbw(1, 0, false, cdb, sizeof(cdb));
+	msc_csw(1, CSW_PASSED, 0);
+	CHECK(!disk_stats.reads);
+
+	cdb[1] = 0x02;		/* BYTCHK */
+	msc_cbw(2, 0, false, cdb, sizeof(cdb));
+	msc_csw(2, CSW_FAILED, 0);
+	msc_sense(3, ILLEGAL_REQUEST, ASC_INVALID_FIELD, 0);
+
+	cdb[1] = 0;
+	cdb[5] = 63;
+	msc_cbw(4, 0, false, cdb, sizeof(cdb));
+	msc_csw(4, CSW_FAILED, 0);
+	msc_sense(5, ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE, 0);
+}
+
+static void test_rw12(void)
+{
+	uint8_t r12[12] = { 0xa8, 0, 0, 0, 0, 5, 0, 0, 0, 3, 0, 0 };
+	uint8_t w12[12] = { 0xaa, 0, 0, 0, 0, 30, 0, 0, 0, 2, 0, 0 };
+	uint8_t sync[10] = { 0x35 };
+
+	msc_setup(64, false);
+	msc_cbw(1, 3 * BLOCK_SIZE, true, r12, sizeof(r12));
+	CHECK(msc_in_all(data, 3 * BLOCK_SIZE) == 3 * BLOCK_SIZE);
+	CHECK(!memcmp(data, disk[5], 3 * BLOCK_SIZE));
+	msc_csw(1, CSW_PASSED, 0);
+
+	memset(data, 0x5a, 2 * BLOCK_SIZE);
+	msc_cbw(2, 2 * BLOCK_SIZE, false, w12, sizeof(w12));
+	msc_out_all(data, 2 * BLOCK_SIZE);
+	msc_csw(2, CSW_PASSED, 0);
+	CHECK(!memcmp(data, disk[30], 2 * BLOCK_SIZE));
+
+	msc_cbw(3, 0, false, sync, sizeof(sync));
+	msc_csw(3, CSW_PASSED, 0);
+
+	/* Past the end of the media. */
+	r12[5] = 62;
+	msc_cbw(4, 3 * BLOCK_SIZE, true, r12, sizeof(r12));
+	CHECK(msc_in_all(data, 3 * BLOCK_SIZE) == 0);
+	msc_csw(4, CSW_FAILED, 3 * BLOCK_SIZE);
+	msc_sense(5, ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE, 0);
+}
+
+/*
+ * 2^23 blocks or more don't fit a 32 bit byte count. A READ(12) that
+ * large still has to be refused in the wrong direction, not written.
+ */
+static void test_huge_rw12(void)
+{
+	uint8_t r12[12] = { 0xa8, 0, 0, 0, 0, 0, 0, 0x80, 0, 0, 0, 0 };
+
+	msc_setup(0x800000 + 16, false);
+	memset(data, 0xee, 8 * BLOCK_SIZE);
+	msc_cbw(1, 8 * BLOCK_SIZE, false, r12, sizeof(r12));
+	msc_out_all(data, 8 * BLOCK_SIZE);
+	msc_csw(1, CSW_PHASE_ERROR, 8 * BLOCK_SIZE);
+	CHECK(!disk_stats.writes);
+	CHECK(disk[0][0] == disk_pattern(0, 0));
+
+	/* Clipped to what the host expects. */
+	msc_cbw(2, 8 * BLOCK_SIZE, true, r12, sizeof(r12));
+	CHECK(msc_in_all(data, 8 * BLOCK_SIZE) == 8 * BLOCK_SIZE);
+	CHECK(!memcmp(data, disk[0], 8 * BLOCK_SIZE));
+	msc_csw(2, CSW_PHASE_ERROR, 0);
+}
+
+static void test_unknown(void)
+{
+	uint8_t cdb[6] = { 0xee };
+
+	msc_setup(64, false);
+	msc_cbw(1, 0, false, cdb, sizeof(cdb));
+	msc_csw(1, CSW_FAILED, 0);
+	msc_sense(2, ILLEGAL_REQUEST, ASC_INVALID_OPCODE, 0);
+}
+
+/* Host expectation against device intent, (A) 6.7 cases 1 to 13. */
+static void test_cases(void)
+{
+	const uint32_t block = BLOCK_SIZE;
+
+	msc_setup(64, false);
+
+	/* 1: Hn = Dn */
+	msc_cbw(1, 0, false, tur, sizeof(tur));
+	msc_csw(1, CSW_PASSED, 0);
+
+	/* 4: Hi > Dn, a zero length packet ends the data phase */
+	msc_cbw(4, block, true, tur, sizeof(tur));
+	CHECK(msc_in_all(data, block) == 0);
+	msc_csw(4, CSW_PASSED, block);
+
+	/* 9: Ho > Dn, the data is received and dropped */
+	msc_cbw(9, block, false, tur, sizeof(tur));
+	msc_out_all(data, block);
+	msc_csw(9, CSW_PASSED, block);
+
+	/* 2: Hn < Di */
+	msc_cbw(2, 0, false, read1, sizeof(read1));
+	msc_csw(2, CSW_PHASE_ERROR, 0);
+
+	/* 5: Hi > Di */
+	msc_cbw(5, 3 * block, true, read2, sizeof(read2));
+	CHECK(msc_in_all(data, 3 * block) == 2 * block);
+	CHECK(!memcmp(data, disk[2], 2 * block));
+	msc_csw(5, CSW_PASSED, block);
+
+	/* 6: Hi = Di */
+	msc_cbw(6, block, true, read1, sizeof(read1));
+	CHECK(msc_in_all(data, block) == block);
+	msc_csw(6, CSW_PASSED, 0);
+
+	/* 7: Hi < Di */
+	msc_cbw(7, 2 * block, true, read4, sizeof(read4));
+	CHECK(msc_in_all(data, 2 * block) == 2 * block);
+	msc_csw(7, CSW_PHASE_ERROR, 0);
+
+	/* 10: Ho <> Di */
+	msc_cbw(10, block, false, read1, sizeof(read1));
+	msc_out_all(data, block);
+	msc_csw(10, CSW_PHASE_ERROR, block);
+
+	/* 3: Hn < Do */
+	msc_cbw(3, 0, false, write1, sizeof(write1));
+	msc_csw(3, CSW_PHASE_ERROR, 0);
+	CHECK(!disk_stats.writes);
+
+	/* 8: Hi <> Do */
+	msc_cbw(8, block, true, write1, sizeof(write1));
+	CHECK(msc_in_all(data, block) == 0);
+	msc_csw(8, CSW_PHASE_ERROR, block);
+	CHECK(!disk_stats.writes);
+
+	/* 11: Ho > Do */
+	memset(data, 0x11, 2 * block);
+	msc_cbw(11, 2 * block, false, write1, sizeof(write1));
+	msc_out_all(data, 2 * block);
+	msc_csw(11, CSW_PASSED, block);
+	CHECK(disk_stats.writes == 1);
+
+	/* 12: Ho = Do */
+	memset(data, 0x12, block);
+	msc_cbw(12, block, false, write1, sizeof(write1));
+	msc_out_all(data, block);
+	msc_csw(12, CSW_PASSED, 0);
+	CHECK(!memcmp(data, disk[2], block));
+
+	/* 13: Ho < Do */
+	memset(data, 0x13, block);
+	msc_cbw(13, block, false, write2, sizeof(write2));
+	msc_out_all(data, block);
+	msc_csw(13, CSW_PHASE_ERROR, 0);
+	CHECK(!memcmp(data, disk[2], block));
+	CHECK(disk[3][0] == disk_pattern(3, 0));
+}
+
+int main(void)
+{
+	test_inquiry();
+	test_capacity();
+	test_mode_sense();
+	test_verify();
+	test_rw12();
+	test_huge_rw12();
+	test_unknown();
+	test_cases();
+	return 0;
+}